@@ -0,0 +1,130 @@
+#include "blockingpool.h"
+
+
+static bool debug = false;
+
+
+BlockingPool::BlockingPool(size_t min_threads, size_t max_threads, uint64_t idle_ms, const std::string &name) :
+                    m_name(name), m_min_threads(min_threads), m_max_threads(max_threads), m_idle_ms(idle_ms)
+{
+    assert(max_threads > 0 && min_threads <= max_threads);
+}
+
+BlockingPool::~BlockingPool()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    m_cond.notify_all();
+
+    //线程在退出前会执行完队列中剩余的任务
+    while(m_thread_count > 0)
+    {
+        m_cond.wait(lock);
+    }
+    m_threads.clear();
+    if(debug) std::cout << "BlockingPool::~BlockingPool() success" << std::endl;
+}
+
+void BlockingPool::submit(std::function<void()> cb)
+{
+    bool need_spawn = false;
+    size_t index = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(cb));
+        ++m_total_tasks;
+
+        size_t depth = m_tasks.size();
+        if(depth > m_max_queue_depth)
+        {
+            m_max_queue_depth = depth;
+        }
+
+        //排队的任务比空闲线程多，说明已有线程都在忙，需要扩容
+        if(depth > m_idle_thread_count && m_thread_count < m_max_threads)
+        {
+            ++m_thread_count;
+            index = m_next_index++;
+            need_spawn = true;
+        }
+        else
+        {
+            m_cond.notify_one();
+        }
+    }
+
+    if(need_spawn)
+    {
+        //在锁外创建线程：Thread的构造函数会等待线程启动完成
+        std::shared_ptr<Thread> thread(new Thread(std::bind(&BlockingPool::run, this), m_name + "_" + std::to_string(index)));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_threads[thread->getId()] = thread;
+        if(debug) std::cout << "BlockingPool::submit() spawn thread, count = " << m_thread_count << std::endl;
+    }
+}
+
+size_t BlockingPool::getQueueDepth()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tasks.size();
+}
+
+size_t BlockingPool::getThreadCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_thread_count;
+}
+
+size_t BlockingPool::getIdleThreadCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle_thread_count;
+}
+
+BlockingPool &BlockingPool::getInstance()
+{
+    static BlockingPool instance;
+    return instance;
+}
+
+void BlockingPool::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        if(!m_tasks.empty())
+        {
+            std::function<void()> cb;
+            cb.swap(m_tasks.front());
+            m_tasks.pop_front();
+
+            lock.unlock();
+            cb();
+            cb = nullptr;   //在锁外释放回调持有的资源
+            lock.lock();
+            continue;
+        }
+
+        if(m_stopping)
+        {
+            break;
+        }
+
+        ++m_idle_thread_count;
+        bool timeout = m_cond.wait_for(lock, std::chrono::milliseconds(m_idle_ms)) == std::cv_status::timeout;
+        --m_idle_thread_count;
+
+        //空闲超时，线程数多于下限时退出
+        if(timeout && m_tasks.empty() && m_thread_count > m_min_threads)
+        {
+            break;
+        }
+    }
+
+    --m_thread_count;
+    if(debug) std::cout << "BlockingPool::run() thread exits, count = " << m_thread_count << std::endl;
+
+    //Thread的析构函数会detach当前线程，此后不能再访问Thread对象
+    m_threads.erase(Thread::getThreadId());
+    m_cond.notify_all();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "thread.h"
+
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <assert.h>
+
+// 执行阻塞操作(普通文件IO、fsync、CPU密集计算等)的弹性线程池。
+// 与Scheduler的工作线程分开：线程数在[min_threads, max_threads]之间按需增长，空闲超过idle_ms的线程自动退出。
+// 调度器通过Scheduler::runBlocking()把任务提交到这里，任务完成后再把挂起的协程放回调度器。
+class BlockingPool
+{
+public:
+    BlockingPool(size_t min_threads = 0, size_t max_threads = 64, uint64_t idle_ms = 10000, const std::string& name = "BlockingPool");
+    ~BlockingPool();
+
+    //提交一个任务，没有空闲线程且未达到上限时创建新线程
+    void submit(std::function<void()> cb);
+
+    //当前排队等待执行的任务数
+    size_t getQueueDepth();
+    //历史最大排队任务数
+    size_t getMaxQueueDepth() const { return m_max_queue_depth; }
+    //当前线程数
+    size_t getThreadCount();
+    //当前空闲线程数
+    size_t getIdleThreadCount();
+    //累计提交的任务数
+    uint64_t getTotalTasks() const { return m_total_tasks; }
+
+public:
+    //进程内共享的默认阻塞线程池
+    static BlockingPool& getInstance();
+
+private:
+    //线程函数
+    void run();
+
+private:
+    std::string m_name;
+    size_t m_min_threads;
+    size_t m_max_threads;
+    uint64_t m_idle_ms;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+
+    //任务队列
+    std::deque<std::function<void()>> m_tasks;
+
+    //线程id -> 线程，线程退出时自己从中删除
+    std::unordered_map<pid_t, std::shared_ptr<Thread>> m_threads;
+
+    //线程数(包括正在创建中的线程)
+    size_t m_thread_count = 0;
+
+    //空闲线程数
+    size_t m_idle_thread_count = 0;
+
+    //线程名编号
+    size_t m_next_index = 0;
+
+    std::atomic<size_t> m_max_queue_depth = {0};
+
+    std::atomic<uint64_t> m_total_tasks = {0};
+
+    bool m_stopping = false;
+
+};
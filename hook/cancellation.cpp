@@ -0,0 +1,88 @@
+#include "cancellation.h"
+
+
+CancellationToken::~CancellationToken()
+{
+    if(m_parent)
+    {
+        m_parent->removeCallback(m_parent_cb);
+    }
+}
+
+void CancellationToken::cancel()
+{
+    std::unordered_map<uint64_t, std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_cancelled.exchange(true, std::memory_order_acq_rel))
+        {
+            return;
+        }
+        callbacks.swap(m_callbacks);
+    }
+
+    //回调会唤醒协程或者取消事件，不能在持有锁时执行
+    for(auto& it : callbacks)
+    {
+        it.second();
+    }
+}
+
+uint64_t CancellationToken::addCallback(std::function<void()> cb)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_cancelled.load(std::memory_order_relaxed))
+        {
+            uint64_t id = m_next_id++;
+            m_callbacks[id] = std::move(cb);
+            return id;
+        }
+    }
+    cb();
+    return 0;
+}
+
+void CancellationToken::removeCallback(uint64_t id)
+{
+    if(id == 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callbacks.erase(id);
+}
+
+std::shared_ptr<CancellationToken> CancellationToken::createChild()
+{
+    std::shared_ptr<CancellationToken> child = std::make_shared<CancellationToken>();
+    std::weak_ptr<CancellationToken> weak_child(child);
+    child->m_parent = shared_from_this();
+    child->m_parent_cb = addCallback([weak_child]()
+    {
+        if(std::shared_ptr<CancellationToken> t = weak_child.lock())
+        {
+            t->cancel();
+        }
+    });
+    return child;
+}
+
+std::shared_ptr<CancellationToken> CancellationToken::getCurrent()
+{
+    return Fiber::getThisPtr()->getCancellationToken();
+}
+
+
+//Task<T>协程可能在另一个线程的调度协程上离开作用域，每次都取当前协程
+CancellationScope::CancellationScope(std::shared_ptr<CancellationToken> token)
+{
+    Fiber* fiber = Fiber::getThisPtr();
+    m_prev = fiber->getCancellationToken();
+    fiber->setCancellationToken(token);
+}
+
+CancellationScope::~CancellationScope()
+{
+    Fiber::getThisPtr()->setCancellationToken(m_prev);
+}
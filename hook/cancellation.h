@@ -0,0 +1,61 @@
+#pragma once
+
+#include "fiber.h"
+
+#include <unordered_map>
+
+// 取消令牌：cancel()之后isCancelled()为true，并执行所有登记的回调。
+// 挂起在hook的IO(包括connect和poll/select/epoll_wait)或sleep上的协程通过回调被唤醒，
+// 相应的调用返回-1且errno为ECANCELED。
+// 令牌可以通过CancellationScope设置为协程的当前令牌，也可以显式地传给需要它的代码。
+class CancellationToken : public std::enable_shared_from_this<CancellationToken>
+{
+public:
+    CancellationToken() = default;
+    ~CancellationToken();
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_acquire); }
+
+    //取消令牌并执行所有回调，只有第一次调用有效
+    void cancel();
+
+    //登记取消时执行的回调，返回用于removeCallback的id。
+    //令牌已经被取消时立即在当前线程执行cb并返回0
+    uint64_t addCallback(std::function<void()> cb);
+    void removeCallback(uint64_t id);
+
+    //创建子令牌：当前令牌被取消时子令牌一并被取消，取消子令牌不影响当前令牌
+    std::shared_ptr<CancellationToken> createChild();
+
+    //当前协程的取消令牌，没有设置时返回nullptr
+    static std::shared_ptr<CancellationToken> getCurrent();
+
+private:
+    std::atomic<bool> m_cancelled = {false};
+
+    std::mutex m_mutex;
+    uint64_t m_next_id = 1;
+    std::unordered_map<uint64_t, std::function<void()>> m_callbacks;
+
+    //子令牌在父令牌上登记的回调，析构时注销
+    std::shared_ptr<CancellationToken> m_parent;
+    uint64_t m_parent_cb = 0;
+};
+
+// 在作用域内把token设置为当前协程的取消令牌，离开作用域时恢复原来的令牌。
+// 在Task<T>协程中同样有效：令牌随协程挂起和恢复(见task.h)。
+// scheduleInline的回调和run_inline的事件、定时器回调直接在调度协程上执行，不应当使用
+class CancellationScope
+{
+public:
+    explicit CancellationScope(std::shared_ptr<CancellationToken> token);
+    ~CancellationScope();
+
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+
+private:
+    std::shared_ptr<CancellationToken> m_prev;
+};
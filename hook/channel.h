@@ -0,0 +1,539 @@
+#pragma once
+
+#include "ioscheduler.h"
+#include "fibersync.h"
+#include "task.h"
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include <errno.h>
+
+// 一次阻塞的send/recv/select的等待状态。select会同时挂在多个通道的等待队列上，
+// 只有第一个调用tryWake()的唤醒者(某个通道或超时定时器)生效，其余的作废。
+struct ChannelWaitState
+{
+    FiberWaiter waiter;
+    std::atomic<bool> fired = {false};
+
+    bool tryWake()
+    {
+        if(fired.exchange(true))
+        {
+            return false;
+        }
+        waiter.wake();
+        return true;
+    }
+};
+
+// Go风格的有界多生产者多消费者通道。
+// 数据放在无锁环形队列中(Vyukov bounded MPMC queue)，缓冲区未满/非空时send/recv只需要几次原子操作；
+// 满或空时才加锁登记等待者并挂起当前协程，由对端在操作成功后唤醒。
+// 容量会向上取整为2的幂。元素通过移动进出通道，大对象不会被拷贝。
+template <class T>
+class Channel
+{
+public:
+    explicit Channel(size_t capacity)
+    {
+        size_t size = 1;
+        while(size < capacity)
+        {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_buffer = new Cell[size];
+        for(size_t i = 0; i < size; ++i)
+        {
+            m_buffer[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~Channel()
+    {
+        //析构时不再有并发的收发，[dequeue_pos, enqueue_pos)中的单元都存放着元素，原地销毁，不要求T可以默认构造
+        size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        for(size_t pos = m_dequeue_pos.load(std::memory_order_relaxed); pos != enqueue_pos; ++pos)
+        {
+            reinterpret_cast<T*>(&m_buffer[pos & m_mask].storage)->~T();
+        }
+        delete[] m_buffer;
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    size_t capacity() const { return m_mask + 1; }
+
+    //当前元素数(并发修改时只是近似值)
+    size_t size() const
+    {
+        size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+    //发送，通道满时挂起当前协程。通道已关闭返回false
+    bool send(const T& value)
+    {
+        T tmp(value);
+        return send(std::move(tmp));
+    }
+
+    bool send(T&& value)
+    {
+        while(true)
+        {
+            if(isClosed())
+            {
+                return false;
+            }
+            if(tryPush(value))
+            {
+                notify(m_recv_waiters, m_recv_waiting);
+                return true;
+            }
+
+            ChannelWaitState state;
+            WaitNode node;
+            node.state = &state;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_send_waiters.push(&node);
+                ++m_send_waiting;
+                //登记之后再检查一次：接收方先出队再检查m_send_waiting，两者至少有一方能看到对方
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(size() <= m_mask || isClosed())
+                {
+                    m_send_waiters.remove(&node);
+                    --m_send_waiting;
+                    continue;
+                }
+            }
+            //被接收方或close()唤醒时节点已经出队，重新尝试
+            state.waiter.park();
+        }
+    }
+
+    //非阻塞发送，通道满或已关闭返回false
+    bool trySend(T&& value)
+    {
+        if(isClosed() || !tryPush(value))
+        {
+            return false;
+        }
+        notify(m_recv_waiters, m_recv_waiting);
+        return true;
+    }
+
+    //接收，通道空时挂起当前协程。通道已关闭且没有剩余元素时返回false
+    bool recv(T& out)
+    {
+        while(true)
+        {
+            if(tryRecv(out))
+            {
+                return true;
+            }
+            if(isClosed())
+            {
+                //关闭前最后发送的元素可能刚刚入队
+                return tryRecv(out);
+            }
+
+            ChannelWaitState state;
+            WaitNode node;
+            node.state = &state;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_recv_waiters.push(&node);
+                ++m_recv_waiting;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(size() > 0 || isClosed())
+                {
+                    m_recv_waiters.remove(&node);
+                    --m_recv_waiting;
+                    continue;
+                }
+            }
+            state.waiter.park();
+        }
+    }
+
+    //带超时的接收，超时返回false且errno为ETIMEDOUT。需要在IOManager中运行
+    bool recv(T& out, uint64_t timeout_ms)
+    {
+        std::vector<Channel<T>*> chans(1, this);
+        return select(chans, out, timeout_ms) == 0;
+    }
+
+    //非阻塞接收，通道空返回false
+    bool tryRecv(T& out)
+    {
+        if(!tryPop(out))
+        {
+            return false;
+        }
+        notify(m_send_waiters, m_send_waiting);
+        return true;
+    }
+
+    //关闭通道：之后的send都返回false，recv取完剩余元素后返回false，唤醒所有等待者
+    void close()
+    {
+        IntrusiveQueue<WaitNode> senders;
+        IntrusiveQueue<WaitNode> receivers;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_closed.exchange(true))
+            {
+                return;
+            }
+            std::swap(senders, m_send_waiters);
+            std::swap(receivers, m_recv_waiters);
+            m_send_waiting = 0;
+            m_recv_waiting = 0;
+        }
+        while(WaitNode* node = senders.pop())
+        {
+            node->state->tryWake();
+        }
+        while(WaitNode* node = receivers.pop())
+        {
+            node->state->tryWake();
+        }
+    }
+
+    //从多个通道中接收，返回成功接收的通道下标。
+    //所有通道都已关闭且为空时返回-1、errno为EPIPE；超时返回-1、errno为ETIMEDOUT。
+    //timeout_ms为~0ull表示不超时，设置超时需要在IOManager中运行
+    static int select(const std::vector<Channel<T>*>& chans, T& out, uint64_t timeout_ms = ~0ull)
+    {
+        auto start = std::chrono::steady_clock::now();
+        while(true)
+        {
+            bool all_closed = true;
+            for(size_t i = 0; i < chans.size(); ++i)
+            {
+                if(chans[i]->tryRecv(out))
+                {
+                    return (int)i;
+                }
+                if(!chans[i]->isClosed())
+                {
+                    all_closed = false;
+                }
+            }
+            if(all_closed)
+            {
+                //关闭前最后发送的元素可能刚刚入队
+                for(size_t i = 0; i < chans.size(); ++i)
+                {
+                    if(chans[i]->tryRecv(out))
+                    {
+                        return (int)i;
+                    }
+                }
+                errno = EPIPE;
+                return -1;
+            }
+
+            uint64_t remaining = ~0ull;
+            if(timeout_ms != ~0ull)
+            {
+                uint64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                if(elapsed >= timeout_ms)
+                {
+                    errno = ETIMEDOUT;
+                    return -1;
+                }
+                remaining = timeout_ms - elapsed;
+            }
+
+            //定时器回调可能在返回之后才执行，等待状态放在堆上由定时器共同持有
+            std::shared_ptr<ChannelWaitState> state(new ChannelWaitState);
+            std::vector<WaitNode> nodes(chans.size());
+            for(size_t i = 0; i < chans.size(); ++i)
+            {
+                nodes[i].state = state.get();
+                chans[i]->addRecvWaiter(&nodes[i]);
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            std::shared_ptr<Timer> timer;
+            if(remaining != ~0ull)
+            {
+                IOManager* iom = IOManager::getThis();
+                assert(iom);
+                timer = iom->addTimer(remaining, [state]()
+                {
+                    state->tryWake();
+                }, false, true);
+            }
+
+            //登记之后再检查一次，已经有数据或通道被关闭就不再挂起。
+            //如果某个唤醒者已经抢先调度了当前协程，仍然要挂起一次把这次调度消费掉
+            bool ready = false;
+            for(size_t i = 0; i < chans.size() && !ready; ++i)
+            {
+                ready = chans[i]->size() > 0 || chans[i]->isClosed();
+            }
+            if(!ready || state->fired.exchange(true))
+            {
+                state->waiter.park();
+            }
+
+            if(timer)
+            {
+                timer->cancel();
+            }
+            for(size_t i = 0; i < chans.size(); ++i)
+            {
+                chans[i]->removeRecvWaiter(&nodes[i]);
+            }
+
+            int index = -1;
+            for(size_t i = 0; i < chans.size(); ++i)
+            {
+                if(chans[i]->tryRecv(out))
+                {
+                    index = (int)i;
+                    break;
+                }
+            }
+
+            //唤醒当前协程的可能是另一个通道，把那次唤醒转交给该通道的其他接收者，避免它们错过数据
+            for(size_t i = 0; i < chans.size(); ++i)
+            {
+                if((int)i != index && chans[i]->size() > 0)
+                {
+                    chans[i]->notify(chans[i]->m_recv_waiters, chans[i]->m_recv_waiting);
+                }
+            }
+
+            if(index >= 0)
+            {
+                return index;
+            }
+        }
+    }
+
+#ifdef __cpp_impl_coroutine
+    //C++20协程版本的send，在协程中co_await ch.sendAsync(v)
+    Task<bool> sendAsync(T value)
+    {
+        while(true)
+        {
+            if(isClosed())
+            {
+                co_return false;
+            }
+            if(tryPush(value))
+            {
+                notify(m_recv_waiters, m_recv_waiting);
+                co_return true;
+            }
+            co_await WaitAwaiter{this, true};
+        }
+    }
+
+    //C++20协程版本的recv，在协程中co_await ch.recvAsync(out)
+    Task<bool> recvAsync(T& out)
+    {
+        while(true)
+        {
+            if(tryRecv(out))
+            {
+                co_return true;
+            }
+            if(isClosed())
+            {
+                co_return tryRecv(out);
+            }
+            co_await WaitAwaiter{this, false};
+        }
+    }
+#endif
+
+private:
+    //等待队列节点，send/recv时分配在等待方的栈上
+    struct WaitNode
+    {
+        ChannelWaitState* state = nullptr;
+        WaitNode* next = nullptr;
+    };
+
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+#ifdef __cpp_impl_coroutine
+    //在通道上登记协程并挂起，直到对端操作成功或通道被关闭。和阻塞版本一样，登记后复查一次状态
+    struct WaitAwaiter
+    {
+        WaitAwaiter(Channel* ch, bool is_sending) : channel(ch), sending(is_sending) {}
+
+        Channel* channel;
+        bool sending;
+        ChannelWaitState state;
+        WaitNode node;
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            state.waiter.fiber = nullptr;
+            state.waiter.handle = h;
+            node.state = &state;
+
+            IntrusiveQueue<WaitNode>& waiters = sending ? channel->m_send_waiters : channel->m_recv_waiters;
+            std::atomic<size_t>& waiting = sending ? channel->m_send_waiting : channel->m_recv_waiting;
+
+            std::lock_guard<std::mutex> lock(channel->m_mutex);
+            waiters.push(&node);
+            ++waiting;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool ready = channel->isClosed() || (sending ? channel->size() <= channel->m_mask : channel->size() > 0);
+            if(ready)
+            {
+                waiters.remove(&node);
+                --waiting;
+                return false;
+            }
+            //解锁之后协程可能被唤醒并在其他线程恢复，不能再访问成员
+            return true;
+        }
+
+        void await_resume() noexcept {}
+    };
+#endif
+
+private:
+    bool tryPush(T& value)
+    {
+        Cell* cell;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while(true)
+        {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0)
+            {
+                if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(diff < 0)
+            {
+                return false;   //满
+            }
+            else
+            {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (&cell->storage) T(std::move(value));
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& out)
+    {
+        Cell* cell;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while(true)
+        {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0)
+            {
+                if(m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(diff < 0)
+            {
+                return false;   //空
+            }
+            else
+            {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        T* value = reinterpret_cast<T*>(&cell->storage);
+        out = std::move(*value);
+        value->~T();
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    //操作成功后唤醒一个对端等待者，没有等待者时只有一次原子读
+    void notify(IntrusiveQueue<WaitNode>& waiters, std::atomic<size_t>& waiting)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiting.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while(WaitNode* node = waiters.pop())
+        {
+            --waiting;
+            //已经被其他通道或超时唤醒的select节点直接丢弃，继续找下一个
+            if(node->state->tryWake())
+            {
+                break;
+            }
+        }
+    }
+
+    void addRecvWaiter(WaitNode* node)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(isClosed())
+        {
+            return;
+        }
+        m_recv_waiters.push(node);
+        ++m_recv_waiting;
+    }
+
+    void removeRecvWaiter(WaitNode* node)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_recv_waiters.remove(node))
+        {
+            --m_recv_waiting;
+        }
+    }
+
+private:
+    Cell* m_buffer = nullptr;
+    size_t m_mask = 0;
+
+    //生产者和消费者的位置放在不同的缓存行，避免伪共享
+    alignas(64) std::atomic<size_t> m_enqueue_pos = {0};
+    alignas(64) std::atomic<size_t> m_dequeue_pos = {0};
+
+    alignas(64) std::atomic<bool> m_closed = {false};
+
+    //等待队列只在满/空时使用
+    std::mutex m_mutex;
+    IntrusiveQueue<WaitNode> m_send_waiters;
+    IntrusiveQueue<WaitNode> m_recv_waiters;
+    std::atomic<size_t> m_send_waiting = {0};
+    std::atomic<size_t> m_recv_waiting = {0};
+};
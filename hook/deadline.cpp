@@ -0,0 +1,41 @@
+#include "deadline.h"
+
+#include <chrono>
+#include <algorithm>
+
+
+//和CancellationScope一样，每次都取当前协程
+DeadlineScope::DeadlineScope(uint64_t timeout_ms)
+{
+    Fiber* fiber = Fiber::getThisPtr();
+    m_prev = fiber->getDeadline();
+
+    uint64_t deadline = now() + timeout_ms;
+    if(timeout_ms == ~0ull || deadline < timeout_ms)   //不限时或溢出
+    {
+        deadline = ~0ull;
+    }
+    fiber->setDeadline(std::min(deadline, m_prev));
+}
+
+DeadlineScope::~DeadlineScope()
+{
+    Fiber::getThisPtr()->setDeadline(m_prev);
+}
+
+uint64_t DeadlineScope::now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t DeadlineScope::getRemaining()
+{
+    uint64_t deadline = Fiber::getThisPtr()->getDeadline();
+    if(deadline == ~0ull)
+    {
+        return ~0ull;
+    }
+
+    uint64_t curr = now();
+    return deadline > curr ? deadline - curr : 0;
+}
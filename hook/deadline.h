@@ -0,0 +1,26 @@
+#pragma once
+
+#include "fiber.h"
+
+// 请求级别的截止时间：在作用域内给当前协程设置一个绝对截止时间，hook中的connect/read/write/sleep/poll等
+// 挂起调用的等待时间取fd自身超时和剩余时间的较小值，超过截止时间返回-1且errno为ETIMEDOUT。
+// 嵌套时取内外两层中较早的截止时间，内层不能延长外层的预算。离开作用域时恢复原来的截止时间。
+// 在Task<T>协程中同样有效(见task.h)，inline回调中不应当使用。
+class DeadlineScope
+{
+public:
+    explicit DeadlineScope(uint64_t timeout_ms);
+    ~DeadlineScope();
+
+    DeadlineScope(const DeadlineScope&) = delete;
+    DeadlineScope& operator=(const DeadlineScope&) = delete;
+
+    //steady_clock的当前毫秒数
+    static uint64_t now();
+
+    //当前协程距离截止时间的剩余毫秒数，已经超时返回0，没有截止时间返回~0ull
+    static uint64_t getRemaining();
+
+private:
+    uint64_t m_prev;
+};
@@ -24,15 +24,25 @@ bool FdCtx::init()
     {
         m_isInit = false;
         m_isSocket = false;
+        m_isPollable = false;
+        m_isRegular = false;
     }
     else
     {
         m_isInit = true;
         m_isSocket = S_ISSOCK(statbuf.st_mode); // S_ISSOCK(statbuf.st_mode) 用于判断文件类型是否为套接字
+
+        // eventfd、timerfd、signalfd、epoll、inotify等都是匿名inode，fstat得到的文件类型位为0
+        bool is_anon_inode = (statbuf.st_mode & S_IFMT) == 0;
+        // 字符设备中只有终端可以可靠地用epoll等待，/dev/null等设备不支持epoll
+        bool is_tty = S_ISCHR(statbuf.st_mode) && isatty(m_fd);
+        m_isPollable = m_isSocket || S_ISFIFO(statbuf.st_mode) || is_anon_inode || is_tty;
+        m_isRegular = S_ISREG(statbuf.st_mode) || S_ISBLK(statbuf.st_mode);
     }
 
 
-    if(m_isSocket)
+    // 能被epoll等待的fd都设置为非阻塞，由hook在EAGAIN时挂起协程来模拟阻塞语义
+    if(m_isPollable)
     {
         int flags = fcntl_f(m_fd, F_GETFL, 0);  // 获取文件描述符的状态
         if(!(flags & O_NONBLOCK))
@@ -43,7 +53,7 @@ bool FdCtx::init()
     }
     else
     {
-        m_sysNonblock = false;  // 如果不是一个 socket 那就没必要设置非阻塞了。
+        m_sysNonblock = false;  // 普通文件等无法被epoll等待，设置非阻塞也没有意义。
     }
 
     return m_isInit;
@@ -16,6 +16,8 @@ class FdCtx : public std::enable_shared_from_this<FdCtx>
 private:
     bool m_isInit = false;  //标记文件描述符是否已初始化
     bool m_isSocket = false;    //标记文件描述符是否是一个套接字。
+    bool m_isPollable = false;  //标记文件描述符是否能用epoll等待：socket、pipe/FIFO、eventfd/timerfd/signalfd等匿名inode以及终端。
+    bool m_isRegular = false;   //标记文件描述符是否是普通文件或块设备：它们无法用epoll等待，读写会真正阻塞线程。
     bool m_sysNonblock = false; //标记文件描述符是否设置为系统非阻塞模式。
     bool m_userNonblock = false;    //标记文件描述符是否设置为用户非阻塞模式。
     bool m_isClosed = false;    //标记文件描述符是否已关闭。
@@ -31,6 +33,8 @@ public:
     bool init();
     bool isInit() const { return m_isInit; }
     bool isSocket() const { return m_isSocket; }
+    bool isPollable() const { return m_isPollable; }
+    bool isRegular() const { return m_isRegular; }
     bool isClosed() const { return m_isClosed; }
 
     void setUserNonblock(bool v) { m_userNonblock = v;} //设置和获取用户层面的非阻塞状态。
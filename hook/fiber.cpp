@@ -8,7 +8,7 @@ static bool debug = false;
 static thread_local Fiber* t_fiber = nullptr;
 
 //主协程
-static thread_local std::shared_ptr<Fiber> t_thread_fiber = nullptr;
+static thread_local FiberPtr t_thread_fiber = nullptr;
 
 //调度协程
 static thread_local Fiber* t_scheduler_fiber = nullptr;
@@ -21,6 +21,12 @@ static std::atomic<uint64_t> s_fiber_id{0};
 //协程计数器
 static std::atomic<uint64_t> s_fiber_count{0};
 
+//当前工作线程的抢占标志，由调度器的看门狗设置
+static thread_local std::atomic<bool>* t_preempt_flag = nullptr;
+
+//已分配的协程局部存储槽位数
+static std::atomic<size_t> s_local_count{0};
+
 /*
 主协程构造函数 (Fiber())
 
@@ -54,8 +60,8 @@ Fiber::Fiber()
 初始化上下文并设置入口函数为 mainFunc
 初始状态为 READY
 */
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler) :
-                m_cb(cb), m_stacksize(stacksize), m_run_in_scheduler(run_in_scheduler)
+Fiber::Fiber(TaskFn cb, size_t stacksize, bool run_in_scheduler) :
+                m_cb(std::move(cb)), m_stacksize(stacksize), m_run_in_scheduler(run_in_scheduler)
 {
     m_state = READY;
 
@@ -65,7 +71,7 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
 
     if(getcontext(&m_ctx))
     {
-        std::cerr << "Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler) failed" << std::endl;
+        std::cerr << "Fiber(TaskFn cb, size_t stacksize, bool run_in_scheduler) failed" << std::endl;
         pthread_exit(nullptr);
     }
 
@@ -78,13 +84,14 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
     s_fiber_count++;
     if(debug)
     {
-        std::cout << "Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler): id = " << m_id << std::endl;
+        std::cout << "Fiber(TaskFn cb, size_t stacksize, bool run_in_scheduler): id = " << m_id << std::endl;
     }
 
 }
 
 Fiber::~Fiber()
 {
+    clearLocals();
     s_fiber_count--;
     if(m_stack)
     {
@@ -96,12 +103,13 @@ Fiber::~Fiber()
     }
 }
 
-void Fiber::reset(std::function<void()> cb)
+void Fiber::reset(TaskFn cb)
 {
     assert(m_stack != nullptr && m_state == TREM);
 
     m_state = READY;
-    m_cb = cb;
+    m_cb = std::move(cb);
+    resetContext();
 
     if(getcontext(&m_ctx))
     {
@@ -177,19 +185,119 @@ void Fiber::setThis(Fiber *f)
 
 
 // 首先运行该函数创建主协程
-std::shared_ptr<Fiber> Fiber::getThis()
+FiberPtr Fiber::getThis()
+{
+    return FiberPtr(getThisPtr());
+}
+
+Fiber* Fiber::getThisPtr()
 {
     if(t_fiber)
     {
-        return t_fiber->shared_from_this();
+        return t_fiber;
+    }
+
+    t_thread_fiber.reset(new Fiber());
+    t_scheduler_fiber = t_thread_fiber.get();   //除非主动设置，主协程默认为调度协程
+
+    assert(t_fiber == t_thread_fiber.get());
+    return t_fiber;
+}
+
+size_t Fiber::allocLocalIndex()
+{
+    return s_local_count++;
+}
+
+bool Fiber::maybeYield()
+{
+    if(!t_preempt_flag || !t_preempt_flag->load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+    t_preempt_flag->store(false, std::memory_order_relaxed);
+
+    //只有调度器调度的协程让出后才会被重新放回队列
+    Fiber* curr = t_fiber;
+    if(!curr || !curr->m_run_in_scheduler)
+    {
+        return false;
+    }
+    curr->m_preempted = true;
+    curr->yield();
+    return true;
+}
+
+void Fiber::setPreemptFlag(std::atomic<bool>* flag)
+{
+    t_preempt_flag = flag;
+}
+
+void Fiber::setLocal(size_t index, void* ptr, void (*dtor)(void*))
+{
+    if(index >= m_locals.size())
+    {
+        m_locals.resize(index + 1);
+    }
+
+    LocalSlot& slot = m_locals[index];
+    if(slot.ptr)
+    {
+        slot.dtor(slot.ptr);
+        for(auto it = m_local_order.begin(); it != m_local_order.end(); ++it)
+        {
+            if(*it == index)
+            {
+                m_local_order.erase(it);
+                break;
+            }
+        }
+    }
+
+    slot.ptr = ptr;
+    slot.dtor = dtor;
+    if(ptr)
+    {
+        m_local_order.push_back(index);
+    }
+}
+
+void Fiber::clearLocals()
+{
+    //析构函数中可能再访问其他FiberLocal，每次只取出最后一个
+    while(!m_local_order.empty())
+    {
+        size_t index = m_local_order.back();
+        m_local_order.pop_back();
+        LocalSlot slot = m_locals[index];
+        m_locals[index] = LocalSlot();
+        slot.dtor(slot.ptr);
     }
+}
+
+void Fiber::swapContext(Context& ctx)
+{
+    m_cancel_token.swap(ctx.cancel_token);
+    std::swap(m_deadline, ctx.deadline);
+    m_locals.swap(ctx.locals);
+    m_local_order.swap(ctx.local_order);
+}
 
-    std::shared_ptr<Fiber> main_fiber(new Fiber());
-    t_thread_fiber = main_fiber;
-    t_scheduler_fiber = main_fiber.get();   //除非主动设置，主协程默认为调度协程
+void Fiber::resetContext()
+{
+    clearLocals();
+    m_cancel_token = nullptr;
+    m_deadline = ~0ull;
+}
 
-    assert(t_fiber == main_fiber.get());
-    return t_fiber->shared_from_this();
+Fiber::Context::~Context()
+{
+    while(!local_order.empty())
+    {
+        size_t index = local_order.back();
+        local_order.pop_back();
+        locals[index].dtor(locals[index].ptr);
+    }
 }
 
 void Fiber::setSchedulerFiber(Fiber *f)
@@ -208,15 +316,16 @@ uint64_t Fiber::getFiberId()
 
 void Fiber::mainFunc()
 {
-    std::shared_ptr<Fiber> curr = getThis();
+    //resume()的调用者持有协程的引用，这里不需要再持有
+    Fiber* curr = getThisPtr();
     assert(curr != nullptr);
 
     curr->m_cb();
     curr->m_cb = nullptr;
+    //协程局部存储在协程自己的栈上销毁
+    curr->clearLocals();
     curr->m_state = TREM;
 
     //运行完毕，让出执行权
-    Fiber* raw_ptr = curr.get();  // 获取原始指针（不影响引用计数）
-    curr.reset();               // 释放共享指针（减少引用计数）
-    raw_ptr->yield();           // 使用原始指针完成上下文切换
+    curr->yield();
 }
@@ -7,8 +7,17 @@
 #include <ucontext.h>
 #include <atomic>
 #include <assert.h>
+#include <vector>
 
-class Fiber : public std::enable_shared_from_this<Fiber>
+#include "taskfn.h"
+
+class CancellationToken;
+class FiberPtr;
+
+// 协程对象内嵌引用计数，由FiberPtr持有，不再使用shared_ptr：
+// 没有单独分配的控制块，getThis()不经过weak_ptr，移动FiberPtr不修改计数。
+// 调度路径上只移动不复制，挂起前后只访问当前协程时用getThisPtr()，不产生原子操作
+class Fiber
 {
 
 public:
@@ -20,15 +29,38 @@ public:
         TREM
     };
 
+    //协程局部存储的一个槽位
+    struct LocalSlot
+    {
+        void* ptr = nullptr;
+        void (*dtor)(void*) = nullptr;
+    };
+
+    //协程的执行上下文：取消令牌、截止时间和协程局部存储。
+    //C++20无栈协程在调度协程上运行，挂起时用swapContext()把自己的上下文换出保存，恢复时换回(见task.h)
+    struct Context
+    {
+        Context() = default;
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+        //销毁还保存在这里的协程局部存储对象(例如协程在挂起状态下被销毁)
+        ~Context();
+
+        std::shared_ptr<CancellationToken> cancel_token;
+        uint64_t deadline = ~0ull;
+        std::vector<LocalSlot> locals;
+        std::vector<size_t> local_order;
+    };
+
 private:
     Fiber();
 
 public:
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true);
+    Fiber(TaskFn cb, size_t stacksize = 0, bool run_in_scheduler = true);
     ~Fiber();
 
     // 重用一个协程
-    void reset(std::function<void()> cb);
+    void reset(TaskFn cb);
 
     //任务线程恢复执行
     void resume();
@@ -38,13 +70,56 @@ public:
 
     uint64_t getId() const { return m_id;}
     State getState() const { return m_state;}
+    //是否由调度器调度：只有这样的协程才能yield后等待被scheduleLock重新调度
+    bool isRunInScheduler() const { return m_run_in_scheduler;}
+
+    //协程的取消令牌，令牌被取消时hook中挂起的IO和sleep会提前返回ECANCELED
+    const std::shared_ptr<CancellationToken>& getCancellationToken() const { return m_cancel_token;}
+    void setCancellationToken(std::shared_ptr<CancellationToken> token) { m_cancel_token = token;}
+
+    //协程的截止时间(steady_clock的毫秒数)，hook中挂起的调用最多等待到这个时间，~0ull表示没有截止时间
+    uint64_t getDeadline() const { return m_deadline;}
+    void setDeadline(uint64_t deadline) { m_deadline = deadline;}
+
+    //是否因为maybeYield()让出，调度器需要把它重新放回队列。读取后清除
+    bool takePreempted() { bool preempted = m_preempted; m_preempted = false; return preempted;}
+
+    //调度优先级(Scheduler::Priority)，协程挂起后被重新调度时沿用这个优先级
+    int getPriority() const { return m_priority;}
+    void setPriority(int priority) { m_priority = priority;}
+
+    //最后一次运行这个协程的线程id，调度器据此把被唤醒的协程优先交给原来的线程，-1表示还没有运行过
+    int getLastThread() const { return m_last_thread;}
+    void setLastThread(int thread_id) { m_last_thread = thread_id;}
+
+    //协程局部存储的槽位，由FiberLocal<T>使用。槽位中的对象在协程结束、reset()或析构时销毁
+    void* getLocal(size_t index) const { return index < m_locals.size() ? m_locals[index].ptr : nullptr;}
+    void setLocal(size_t index, void* ptr, void (*dtor)(void*));
+
+    //和ctx交换取消令牌、截止时间和协程局部存储
+    void swapContext(Context& ctx);
+    //销毁协程局部存储并清除取消令牌和截止时间
+    void resetContext();
 
 public:
     // 设置当前运行的协程
     static void setThis(Fiber* f);
 
-    // 得到当前运行的协程
-    static std::shared_ptr<Fiber> getThis();
+    // 得到当前运行的协程，引用计数加一
+    static FiberPtr getThis();
+
+    // 得到当前运行的协程的裸指针，不增加引用计数，用于频繁访问的场景
+    static Fiber* getThisPtr();
+
+    //分配一个协程局部存储的槽位下标，槽位不回收
+    static size_t allocLocalIndex();
+
+    //协作式抢占点：调度器的看门狗发现当前协程连续运行超过时间片时，在这里让出执行权并重新排队。
+    //不做hook IO的长计算循环应当定期调用，未被要求抢占时只有一次线程局部变量读取。返回是否让出过
+    static bool maybeYield();
+
+    //设置当前线程的抢占标志，由调度器的工作线程调用
+    static void setPreemptFlag(std::atomic<bool>* flag);
 
     //设置调度协程(默认为主协程)
     static void setSchedulerFiber(Fiber* f);
@@ -55,6 +130,22 @@ public:
     // 协程函数
     static void mainFunc();
 
+private:
+    //销毁所有协程局部存储对象，按创建的相反顺序
+    void clearLocals();
+
+    friend class FiberPtr;
+
+    //协程可能在其他线程上被唤醒和释放，计数仍然是原子的；增加计数不需要同步
+    void addRef() { m_refs.fetch_add(1, std::memory_order_relaxed);}
+    void release()
+    {
+        if(m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+    }
+
 private:
     //id
     uint64_t m_id = 0;
@@ -67,11 +158,101 @@ private:
     //栈指针
     void* m_stack = nullptr;
     //协程函数
-    std::function<void()> m_cb;
+    TaskFn m_cb;
     //是否让出执行权交给调度协程
-    bool m_run_in_scheduler;
+    bool m_run_in_scheduler = false;
+    //取消令牌
+    std::shared_ptr<CancellationToken> m_cancel_token;
+    //截止时间
+    uint64_t m_deadline = ~0ull;
+    //调度优先级，默认Scheduler::PRIORITY_NORMAL
+    int m_priority = 1;
+    //被抢占让出
+    bool m_preempted = false;
+    //最后一次运行的线程
+    int m_last_thread = -1;
+    //FiberPtr的引用计数
+    std::atomic<uint32_t> m_refs = {0};
+
+    //协程局部存储
+    std::vector<LocalSlot> m_locals;
+    //槽位的填充顺序，销毁时倒序
+    std::vector<size_t> m_local_order;
 
 public:
     std::mutex m_mutex;
 
 };
+
+// 协程的侵入式智能指针，用法和shared_ptr<Fiber>相同。从裸指针构造时引用计数加一，
+// 因此可以随时由Fiber*重新得到FiberPtr，例如FiberPtr(new Fiber(cb))、FiberPtr(Fiber::getThisPtr())
+class FiberPtr
+{
+public:
+    FiberPtr() noexcept = default;
+    FiberPtr(std::nullptr_t) noexcept {}
+
+    explicit FiberPtr(Fiber* p) : m_ptr(p)
+    {
+        if(m_ptr)
+        {
+            m_ptr->addRef();
+        }
+    }
+
+    FiberPtr(const FiberPtr& other) : FiberPtr(other.m_ptr) {}
+
+    FiberPtr(FiberPtr&& other) noexcept : m_ptr(other.m_ptr)
+    {
+        other.m_ptr = nullptr;
+    }
+
+    FiberPtr& operator=(const FiberPtr& other)
+    {
+        FiberPtr(other).swap(*this);
+        return *this;
+    }
+
+    FiberPtr& operator=(FiberPtr&& other) noexcept
+    {
+        FiberPtr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    FiberPtr& operator=(std::nullptr_t)
+    {
+        reset();
+        return *this;
+    }
+
+    ~FiberPtr()
+    {
+        if(m_ptr)
+        {
+            m_ptr->release();
+        }
+    }
+
+    void reset(Fiber* p = nullptr)
+    {
+        FiberPtr(p).swap(*this);
+    }
+
+    void swap(FiberPtr& other) noexcept
+    {
+        std::swap(m_ptr, other.m_ptr);
+    }
+
+    Fiber* get() const noexcept { return m_ptr;}
+    Fiber* operator->() const noexcept { return m_ptr;}
+    Fiber& operator*() const noexcept { return *m_ptr;}
+    explicit operator bool() const noexcept { return m_ptr != nullptr;}
+
+    bool operator==(const FiberPtr& other) const noexcept { return m_ptr == other.m_ptr;}
+    bool operator!=(const FiberPtr& other) const noexcept { return m_ptr != other.m_ptr;}
+    bool operator==(std::nullptr_t) const noexcept { return m_ptr == nullptr;}
+    bool operator!=(std::nullptr_t) const noexcept { return m_ptr != nullptr;}
+
+private:
+    Fiber* m_ptr = nullptr;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "fiber.h"
+
+// 协程局部存储：每个协程各有一份T，协程在调度器的工作线程之间迁移时跟着协程走(thread_local做不到这一点)。
+// 每个FiberLocal在构造时分配一个槽位下标，访问时用下标直接索引当前协程的槽位数组。
+// 比thread_local多一次取当前协程的函数调用和一次下标检查，每次访问多约2ns(见tests/test_fiberlocal.cpp)。
+// 对象在协程第一次访问时默认构造，在协程结束、reset()或析构时销毁。
+// Task<T>协程(包括它co_await的子协程)共用一份，挂起时随协程保存，结束时销毁(见task.h)。
+// scheduleInline的回调和run_inline的事件、定时器回调直接在调度协程上执行，不应当使用FiberLocal。
+// 槽位下标不回收，FiberLocal应当作为静态或全局对象使用，不要频繁创建。
+template <class T>
+class FiberLocal
+{
+public:
+    FiberLocal() : m_index(Fiber::allocLocalIndex()) {}
+
+    FiberLocal(const FiberLocal&) = delete;
+    FiberLocal& operator=(const FiberLocal&) = delete;
+
+    //当前协程的对象，不存在时默认构造
+    T& get()
+    {
+        Fiber* fiber = Fiber::getThisPtr();
+        void* ptr = fiber->getLocal(m_index);
+        if(!ptr)
+        {
+            ptr = new T();
+            fiber->setLocal(m_index, ptr, &FiberLocal::destroy);
+        }
+        return *static_cast<T*>(ptr);
+    }
+
+    //替换当前协程的对象
+    void set(T value)
+    {
+        Fiber::getThisPtr()->setLocal(m_index, new T(std::move(value)), &FiberLocal::destroy);
+    }
+
+    //当前协程是否已经有这个对象
+    bool has() const { return Fiber::getThisPtr()->getLocal(m_index) != nullptr; }
+
+    //提前销毁当前协程的对象
+    void reset() { Fiber::getThisPtr()->setLocal(m_index, nullptr, nullptr); }
+
+    T& operator*() { return get(); }
+    T* operator->() { return &get(); }
+
+private:
+    static void destroy(void* ptr) { delete static_cast<T*>(ptr); }
+
+private:
+    size_t m_index;
+};
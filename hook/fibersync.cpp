@@ -0,0 +1,299 @@
+#include "fibersync.h"
+#include "ioscheduler.h"
+
+
+FiberWaiter::FiberWaiter()
+{
+    scheduler = Scheduler::getThis();
+    if(scheduler)
+    {
+        //只有被调度器调度的协程才能挂起后由scheduleLock恢复，主协程和调度协程只能阻塞线程
+        Fiber* curr = Fiber::getThisPtr();
+        if(curr->isRunInScheduler())
+        {
+            fiber.reset(curr);
+        }
+    }
+}
+
+void FiberWaiter::park()
+{
+    if(fiber)
+    {
+        fiber->yield();
+    }
+    else
+    {
+        sem.wait();
+    }
+}
+
+void FiberWaiter::wake()
+{
+    //唤醒之后等待者可能立即返回并销毁(它在等待方的栈上)，这里之后不能再访问成员
+#ifdef __cpp_impl_coroutine
+    if(handle)
+    {
+        scheduler->scheduleLock(handle, -1);
+        return;
+    }
+#endif
+    if(fiber)
+    {
+        scheduler->scheduleLock(fiber, -1);
+    }
+    else
+    {
+        sem.signal();
+    }
+}
+
+
+//唤醒队列中的所有等待者，调用时不能持有同步原语的锁
+static void wakeAll(WaitQueue& waiters)
+{
+    while(FiberWaiter* waiter = waiters.pop())
+    {
+        waiter->wake();
+    }
+}
+
+
+void FiberMutex::lockSlow()
+{
+    FiberWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        //先标记为有竞争，如果原来是UNLOCKED说明锁刚好被释放了，直接获得锁
+        if(m_state.exchange(CONTENDED, std::memory_order_acquire) == UNLOCKED)
+        {
+            return;
+        }
+        m_waiters.push(&waiter);
+    }
+
+    //被唤醒时锁已经由unlock()直接转交给当前协程
+    waiter.park();
+}
+
+void FiberMutex::unlockSlow()
+{
+    FiberWaiter* waiter = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        waiter = m_waiters.pop();
+        if(!waiter)
+        {
+            m_state.store(UNLOCKED, std::memory_order_release);
+            return;
+        }
+        //不释放锁而是直接转交给被唤醒的等待者，避免它醒来后再次竞争失败
+        m_state.store(m_waiters.empty() ? LOCKED : CONTENDED, std::memory_order_release);
+    }
+    waiter->wake();
+}
+
+
+void FiberCondVar::wait(std::unique_lock<FiberMutex> &lock)
+{
+    FiberWaiter waiter;
+    {
+        //先入队再释放用户的锁，notify不会丢失
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_waiters.push(&waiter);
+    }
+    lock.unlock();
+    waiter.park();
+    lock.lock();
+}
+
+bool FiberCondVar::wait_for(std::unique_lock<FiberMutex> &lock, uint64_t timeout_ms)
+{
+    IOManager* iom = IOManager::getThis();
+    assert(iom);
+
+    //定时器回调可能在返回之后才执行，等待者放在堆上由定时器共同持有。
+    //回调只唤醒等待者，不访问条件变量本身
+    std::shared_ptr<FiberWaiter> waiter(new FiberWaiter);
+    std::shared_ptr<std::atomic<bool>> timed_out(new std::atomic<bool>(false));
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_waiters.push(waiter.get());
+    }
+    std::shared_ptr<Timer> timer = iom->addTimer(timeout_ms, [waiter, timed_out]()
+    {
+        //先标记再唤醒，等待者醒来后一定能看到
+        if(!waiter->woken.exchange(true))
+        {
+            *timed_out = true;
+            waiter->wake();
+        }
+    }, false, true);
+    lock.unlock();
+    waiter->park();
+    timer->cancel();
+    if(*timed_out)
+    {
+        //超时的等待者可能还在队列中。notify在这把锁下取出等待者并检查woken，加锁之后它不会再访问当前等待者
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_waiters.remove(waiter.get());
+    }
+    lock.lock();
+    return !*timed_out;
+}
+
+void FiberCondVar::notify_one()
+{
+    FiberWaiter* waiter = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        //跳过已经超时的等待者，保证通知不会丢失
+        while((waiter = m_waiters.pop()) && waiter->woken.exchange(true));
+    }
+    if(waiter)
+    {
+        waiter->wake();
+    }
+}
+
+void FiberCondVar::notify_all()
+{
+    WaitQueue waiters;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        while(FiberWaiter* waiter = m_waiters.pop())
+        {
+            if(!waiter->woken.exchange(true))
+            {
+                waiters.push(waiter);
+            }
+        }
+    }
+    wakeAll(waiters);
+}
+
+
+void FiberSemaphore::waitSlow()
+{
+    FiberWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        //先登记再检查计数：signal()先加计数再检查m_waiting，两者至少有一方能看到对方
+        m_waiting.fetch_add(1, std::memory_order_seq_cst);
+        if(tryWait())
+        {
+            m_waiting.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+        m_waiters.push(&waiter);
+    }
+
+    //被唤醒时计数已经由signal()替当前协程减掉
+    waiter.park();
+}
+
+void FiberSemaphore::signalSlow()
+{
+    WaitQueue waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while(!m_waiters.empty() && tryWait())
+        {
+            waiters.push(m_waiters.pop());
+            m_waiting.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    wakeAll(waiters);
+}
+
+
+void FiberRWLock::lockSharedSlow()
+{
+    FiberWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while(true)
+        {
+            if(!(state & (WRITER | WAITING)))
+            {
+                if(m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire))
+                {
+                    return;
+                }
+                continue;
+            }
+            //在持有者释放之前设置WAITING，保证它的快速解锁路径失败并进入unlockSlow()
+            if(m_state.compare_exchange_weak(state, state | WAITING, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        m_readers.push(&waiter);
+        ++m_reader_count;
+    }
+
+    //被唤醒时读者计数已经由unlockSlow()替当前协程加上
+    waiter.park();
+}
+
+void FiberRWLock::lockSlow()
+{
+    FiberWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while(true)
+        {
+            if(state == 0)
+            {
+                if(m_state.compare_exchange_weak(state, WRITER, std::memory_order_acquire))
+                {
+                    return;
+                }
+                continue;
+            }
+            if(m_state.compare_exchange_weak(state, state | WAITING, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        m_writers.push(&waiter);
+    }
+
+    waiter.park();
+}
+
+void FiberRWLock::unlockSlow(bool writer_released)
+{
+    WaitQueue waiters;
+    {
+        //此时没有任何持有者且WAITING已置位，快速路径都会失败，状态只会在这把锁下被修改
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        uint32_t state = 0;
+        if((writer_released || m_writers.empty()) && !m_readers.empty())
+        {
+            //写者释放时优先唤醒全部排队的读者
+            state = m_reader_count;
+            m_reader_count = 0;
+            std::swap(waiters, m_readers);
+            if(!m_writers.empty())
+            {
+                state |= WAITING;
+            }
+        }
+        else if(!m_writers.empty())
+        {
+            //最后一个读者释放时优先唤醒写者
+            waiters.push(m_writers.pop());
+            state = WRITER;
+            if(!m_writers.empty() || !m_readers.empty())
+            {
+                state |= WAITING;
+            }
+        }
+        m_state.store(state, std::memory_order_release);
+    }
+    wakeAll(waiters);
+}
@@ -0,0 +1,325 @@
+#pragma once
+
+#include "scheduler.h"
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+// 协程级别的同步原语：竞争时只挂起当前协程，由释放方通过Scheduler::scheduleLock重新调度，
+// 工作线程上的其他协程不受影响。不在调度器协程中(例如主协程或普通线程)使用时退化为阻塞线程。
+
+// 挂起在同步原语上的等待者。分配在等待方的栈上，通过next串成侵入式队列，入队出队不需要分配内存。
+struct FiberWaiter
+{
+    FiberWaiter();
+
+    //挂起当前协程(或线程)，直到被wake()
+    void park();
+    //唤醒等待者，协程会被放回它所属的调度器
+    void wake();
+
+    //等待的协程，为空表示等待者是普通线程
+    FiberPtr fiber;
+    Scheduler* scheduler = nullptr;
+#ifdef __cpp_impl_coroutine
+    //等待的是C++20协程时由awaiter设置，唤醒时把它放回调度器，此时不能调用park()
+    std::coroutine_handle<> handle;
+#endif
+    //普通线程用信号量阻塞
+    Semaphore sem;
+    //有多个唤醒者(例如通知和超时定时器)时，先把它置为true的一方负责唤醒
+    std::atomic<bool> woken = {false};
+    FiberWaiter* next = nullptr;
+};
+
+// 先进先出的侵入式队列，Node需要有一个Node* next成员。
+// 不是线程安全的，由使用它的同步原语加锁保护
+template <class Node>
+class IntrusiveQueue
+{
+public:
+    bool empty() const { return m_head == nullptr; }
+
+    void push(Node* node)
+    {
+        node->next = nullptr;
+        if(m_tail)
+        {
+            m_tail->next = node;
+        }
+        else
+        {
+            m_head = node;
+        }
+        m_tail = node;
+    }
+
+    Node* pop()
+    {
+        Node* node = m_head;
+        if(node)
+        {
+            m_head = node->next;
+            if(!m_head)
+            {
+                m_tail = nullptr;
+            }
+            node->next = nullptr;
+        }
+        return node;
+    }
+
+    //从队列中删除指定的节点(例如等待超时)，不在队列中返回false
+    bool remove(Node* node)
+    {
+        Node* prev = nullptr;
+        for(Node* it = m_head; it; prev = it, it = it->next)
+        {
+            if(it != node)
+            {
+                continue;
+            }
+
+            if(prev)
+            {
+                prev->next = it->next;
+            }
+            else
+            {
+                m_head = it->next;
+            }
+            if(m_tail == it)
+            {
+                m_tail = prev;
+            }
+            it->next = nullptr;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    Node* m_head = nullptr;
+    Node* m_tail = nullptr;
+};
+
+typedef IntrusiveQueue<FiberWaiter> WaitQueue;
+
+// 互斥锁，满足BasicLockable，可以配合std::lock_guard/std::unique_lock使用
+class FiberMutex
+{
+public:
+    FiberMutex() = default;
+    FiberMutex(const FiberMutex&) = delete;
+    FiberMutex& operator=(const FiberMutex&) = delete;
+
+    void lock()
+    {
+        int expected = UNLOCKED;
+        if(!m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire))
+        {
+            lockSlow();
+        }
+    }
+
+    bool try_lock()
+    {
+        int expected = UNLOCKED;
+        return m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire);
+    }
+
+    void unlock()
+    {
+        if(m_state.fetch_sub(1, std::memory_order_release) != LOCKED)
+        {
+            unlockSlow();
+        }
+    }
+
+private:
+    void lockSlow();
+    void unlockSlow();
+
+private:
+    //锁状态：无竞争时加锁、解锁各只需要一次原子操作
+    enum
+    {
+        UNLOCKED = 0,
+        LOCKED = 1,     //已加锁，没有等待者
+        CONTENDED = 2   //已加锁，可能有等待者
+    };
+    std::atomic<int> m_state = {UNLOCKED};
+
+    //保护等待队列
+    std::mutex m_mutex;
+    WaitQueue m_waiters;
+};
+
+// 条件变量，配合FiberMutex使用
+class FiberCondVar
+{
+public:
+    FiberCondVar() = default;
+    FiberCondVar(const FiberCondVar&) = delete;
+    FiberCondVar& operator=(const FiberCondVar&) = delete;
+
+    void wait(std::unique_lock<FiberMutex>& lock);
+
+    template <class Predicate>
+    void wait(std::unique_lock<FiberMutex>& lock, Predicate pred)
+    {
+        while(!pred())
+        {
+            wait(lock);
+        }
+    }
+
+    //最多等待timeout_ms毫秒，超时返回false。需要在IOManager中运行
+    bool wait_for(std::unique_lock<FiberMutex>& lock, uint64_t timeout_ms);
+
+    //超时返回pred()的结果
+    template <class Predicate>
+    bool wait_for(std::unique_lock<FiberMutex>& lock, uint64_t timeout_ms, Predicate pred)
+    {
+        auto start = std::chrono::steady_clock::now();
+        while(!pred())
+        {
+            uint64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            if(elapsed >= timeout_ms || !wait_for(lock, timeout_ms - elapsed))
+            {
+                return pred();
+            }
+        }
+        return true;
+    }
+
+    void notify_one();
+    void notify_all();
+
+private:
+    std::mutex m_mutex;
+    WaitQueue m_waiters;
+};
+
+// 计数信号量
+class FiberSemaphore
+{
+public:
+    explicit FiberSemaphore(int count = 0) : m_count(count) {}
+    FiberSemaphore(const FiberSemaphore&) = delete;
+    FiberSemaphore& operator=(const FiberSemaphore&) = delete;
+
+    //P操作
+    void wait()
+    {
+        if(!tryWait())
+        {
+            waitSlow();
+        }
+    }
+
+    bool tryWait()
+    {
+        int count = m_count.load(std::memory_order_relaxed);
+        while(count > 0)
+        {
+            if(m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //V操作
+    void signal()
+    {
+        m_count.fetch_add(1, std::memory_order_seq_cst);
+        if(m_waiting.load(std::memory_order_seq_cst) > 0)
+        {
+            signalSlow();
+        }
+    }
+
+private:
+    void waitSlow();
+    void signalSlow();
+
+private:
+    std::atomic<int> m_count;
+    //排队等待的数量，signal()据此判断是否需要进入慢路径
+    std::atomic<int> m_waiting = {0};
+
+    std::mutex m_mutex;
+    WaitQueue m_waiters;
+};
+
+// 读写锁，写者优先：有写者排队时新的读者也要排队；写者释放时优先唤醒全部排队的读者，避免读者饥饿。
+// 满足SharedLockable，可以配合std::shared_lock/std::unique_lock使用
+class FiberRWLock
+{
+public:
+    FiberRWLock() = default;
+    FiberRWLock(const FiberRWLock&) = delete;
+    FiberRWLock& operator=(const FiberRWLock&) = delete;
+
+    void lock_shared()
+    {
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while(!(state & (WRITER | WAITING)))
+        {
+            if(m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire))
+            {
+                return;
+            }
+        }
+        lockSharedSlow();
+    }
+
+    void unlock_shared()
+    {
+        //最后一个读者离开且有人排队时需要唤醒
+        if(m_state.fetch_sub(1, std::memory_order_release) - 1 == WAITING)
+        {
+            unlockSlow(false);
+        }
+    }
+
+    void lock()
+    {
+        uint32_t expected = 0;
+        if(!m_state.compare_exchange_strong(expected, WRITER, std::memory_order_acquire))
+        {
+            lockSlow();
+        }
+    }
+
+    void unlock()
+    {
+        uint32_t expected = WRITER;
+        if(!m_state.compare_exchange_strong(expected, 0, std::memory_order_release))
+        {
+            unlockSlow(true);
+        }
+    }
+
+private:
+    void lockSharedSlow();
+    void lockSlow();
+    //锁已经完全释放且有等待者时，把锁转交给下一批等待者
+    void unlockSlow(bool writer_released);
+
+private:
+    //低30位是持有锁的读者数
+    static const uint32_t WRITER = 1u << 30;    //写者持有锁
+    static const uint32_t WAITING = 1u << 31;   //有读者或写者在排队
+    static const uint32_t READERS_MASK = WRITER - 1;
+
+    std::atomic<uint32_t> m_state = {0};
+
+    std::mutex m_mutex;
+    WaitQueue m_readers;
+    size_t m_reader_count = 0;
+    WaitQueue m_writers;
+};
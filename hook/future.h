@@ -0,0 +1,405 @@
+#pragma once
+
+#include "scheduler.h"
+#include "fibersync.h"
+
+#include <vector>
+#include <future>
+
+// Future/Promise：get()/wait()只挂起当前协程，由setValue()通过scheduleLock重新调度。
+// 共享状态由Promise创建时一次分配，等待者是侵入式队列，挂起和唤醒都不需要额外的内存分配。
+
+// 组合器登记在共享状态上的就绪回调。节点由组合器为所有输入一次分配，
+// 和等待者一样串成侵入式队列，登记和执行时都不再分配内存
+struct FutureCallback
+{
+    void (*fn)(FutureCallback*) = nullptr;
+    FutureCallback* next = nullptr;
+};
+
+// 共享状态中与结果类型无关的部分
+class FutureStateBase
+{
+public:
+    bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+    //挂起直到结果就绪
+    void wait()
+    {
+        if(isReady())
+        {
+            return;
+        }
+
+        FiberWaiter waiter;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(isReady())
+            {
+                return;
+            }
+            m_waiters.push(&waiter);
+        }
+        waiter.park();
+    }
+
+    //结果就绪后执行cb->fn(cb)(已经就绪则立即执行)，供whenAll/whenAny使用。
+    //执行之前cb必须保持有效，fn中可以释放cb
+    void onReady(FutureCallback* cb)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(!m_ready.load(std::memory_order_relaxed))
+            {
+                m_callbacks.push(cb);
+                return;
+            }
+        }
+        cb->fn(cb);
+    }
+
+    void setException(std::exception_ptr eptr)
+    {
+        m_exception = eptr;
+        complete();
+    }
+
+protected:
+    //结果已经写入，标记就绪并唤醒所有等待者
+    void complete()
+    {
+        WaitQueue waiters;
+        IntrusiveQueue<FutureCallback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            assert(!m_ready.load(std::memory_order_relaxed));
+            m_ready.store(true, std::memory_order_release);
+            std::swap(waiters, m_waiters);
+            std::swap(callbacks, m_callbacks);
+        }
+        while(FiberWaiter* waiter = waiters.pop())
+        {
+            waiter->wake();
+        }
+        //pop()先取出下一个节点，回调释放当前节点也没有关系
+        while(FutureCallback* cb = callbacks.pop())
+        {
+            cb->fn(cb);
+        }
+    }
+
+    void rethrowIfFailed()
+    {
+        if(m_exception)
+        {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+private:
+    std::atomic<bool> m_ready = {false};
+    std::exception_ptr m_exception;
+
+    std::mutex m_mutex;
+    WaitQueue m_waiters;
+    //就绪时执行的回调，只有组合器会登记
+    IntrusiveQueue<FutureCallback> m_callbacks;
+};
+
+template <class T>
+class FutureState : public FutureStateBase
+{
+public:
+    void setValue(T value)
+    {
+        m_value.emplace(std::move(value));
+        complete();
+    }
+
+    T get()
+    {
+        wait();
+        rethrowIfFailed();
+        return std::move(*m_value);
+    }
+
+private:
+    std::optional<T> m_value;
+};
+
+template <>
+class FutureState<void> : public FutureStateBase
+{
+public:
+    void setValue() { complete(); }
+
+    void get()
+    {
+        wait();
+        rethrowIfFailed();
+    }
+};
+
+
+// 结果的读取端，只能移动。get()取走结果后Future失效
+template <class T>
+class Future
+{
+public:
+    Future() = default;
+    explicit Future(std::shared_ptr<FutureState<T>> state) : m_state(std::move(state)) {}
+
+    Future(Future&&) = default;
+    Future& operator=(Future&&) = default;
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    bool valid() const { return m_state != nullptr; }
+    bool isReady() const { return m_state && m_state->isReady(); }
+
+    //挂起当前协程直到结果就绪
+    void wait() const
+    {
+        assert(m_state);
+        m_state->wait();
+    }
+
+    //挂起当前协程直到结果就绪，返回结果或重新抛出异常
+    T get()
+    {
+        assert(m_state);
+        std::shared_ptr<FutureState<T>> state;
+        state.swap(m_state);
+        return state->get();
+    }
+
+    const std::shared_ptr<FutureState<T>>& getState() const { return m_state; }
+
+private:
+    std::shared_ptr<FutureState<T>> m_state;
+};
+
+
+// 结果的写入端，只能移动。没有设置结果就被销毁时，Future::get()抛出broken_promise
+template <class T>
+class Promise
+{
+public:
+    Promise() : m_state(std::make_shared<FutureState<T>>()) {}
+
+    ~Promise()
+    {
+        abandon();
+    }
+
+    Promise(Promise&&) = default;
+
+    //被覆盖的Promise和析构一样，没有设置结果时让它的Future得到broken_promise
+    Promise& operator=(Promise&& other)
+    {
+        if(this != &other)
+        {
+            abandon();
+            m_state = std::move(other.m_state);
+            m_retrieved = other.m_retrieved;
+        }
+        return *this;
+    }
+
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    //只能调用一次
+    Future<T> getFuture()
+    {
+        assert(m_state && !m_retrieved);
+        m_retrieved = true;
+        return Future<T>(m_state);
+    }
+
+    template <class... Args>
+    void setValue(Args&&... args)
+    {
+        assert(m_state);
+        m_state->setValue(std::forward<Args>(args)...);
+    }
+
+    void setException(std::exception_ptr eptr)
+    {
+        assert(m_state);
+        m_state->setException(eptr);
+    }
+
+private:
+    void abandon()
+    {
+        if(m_state && !m_state->isReady())
+        {
+            m_state->setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+
+private:
+    std::shared_ptr<FutureState<T>> m_state;
+    bool m_retrieved = false;
+};
+
+
+namespace detail
+{
+    //执行fn并把结果或异常写入promise
+    template <class Fn, class T>
+    void fulfill(Fn& fn, Promise<T>& promise)
+    {
+        try
+        {
+            promise.setValue(fn());
+        }
+        catch(...)
+        {
+            promise.setException(std::current_exception());
+        }
+    }
+
+    template <class Fn>
+    void fulfill(Fn& fn, Promise<void>& promise)
+    {
+        try
+        {
+            fn();
+            promise.setValue();
+        }
+        catch(...)
+        {
+            promise.setException(std::current_exception());
+        }
+    }
+}
+
+template <class Fn>
+auto Scheduler::spawn(Fn fn) -> Future<decltype(fn())>
+{
+    typedef decltype(fn()) Result;
+
+    //调度路径上的TaskFn只需要可移动，Promise和fn直接移动进任务，只能移动的fn(例如捕获了unique_ptr)也可以spawn
+    Promise<Result> promise;
+    Future<Result> future = promise.getFuture();
+    scheduleLock([promise = std::move(promise), fn = std::move(fn)]() mutable
+    {
+        detail::fulfill(fn, promise);
+    });
+    return future;
+}
+
+
+namespace detail
+{
+    // whenAll/whenAny的结果状态，和每个输入future上的回调节点一起一次分配。
+    // 节点挂在输入的共享状态上，所有回调执行完之前由m_self保持存活，调用者丢弃返回的Future也没有关系
+    template <class R>
+    class CombinatorState : public FutureState<R>
+    {
+    public:
+        struct Link : public FutureCallback
+        {
+            CombinatorState* owner = nullptr;
+            size_t index = 0;
+        };
+
+        //on_ready(state, index)在第index个输入就绪时执行
+        template <class T>
+        static std::shared_ptr<CombinatorState> create(const std::vector<Future<T>>& futures,
+                                                       void (*on_ready)(CombinatorState*, size_t))
+        {
+            std::shared_ptr<CombinatorState> state = std::make_shared<CombinatorState>();
+            state->m_on_ready = on_ready;
+            state->m_pending.store(futures.size(), std::memory_order_relaxed);
+            state->m_links.resize(futures.size());
+            state->m_self = state;
+            for(size_t i = 0; i < futures.size(); ++i)
+            {
+                assert(futures[i].valid());
+                Link& link = state->m_links[i];
+                link.fn = &CombinatorState::fire;
+                link.owner = state.get();
+                link.index = i;
+            }
+            //先准备好所有节点再登记，已经就绪的输入会立即执行回调
+            for(size_t i = 0; i < futures.size(); ++i)
+            {
+                futures[i].getState()->onReady(&state->m_links[i]);
+            }
+            return state;
+        }
+
+        //输入的future数
+        size_t inputCount() const { return m_links.size(); }
+
+        //已经就绪的输入数
+        size_t readyCount() const { return m_links.size() - m_pending.load(std::memory_order_acquire); }
+
+        //第一个就绪的输入调用时返回true
+        bool claimFirst() { return !m_first.exchange(true, std::memory_order_acq_rel); }
+
+    private:
+        static void fire(FutureCallback* cb)
+        {
+            Link* link = static_cast<Link*>(cb);
+            CombinatorState* state = link->owner;
+            size_t index = link->index;
+            bool last = state->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+            state->m_on_ready(state, index);
+            if(last)
+            {
+                //所有节点都已经从输入上取下，可以释放
+                std::shared_ptr<CombinatorState> self;
+                self.swap(state->m_self);
+            }
+        }
+
+    private:
+        void (*m_on_ready)(CombinatorState*, size_t) = nullptr;
+        std::vector<Link> m_links;
+        std::atomic<size_t> m_pending = {0};
+        std::atomic<bool> m_first = {false};
+        std::shared_ptr<CombinatorState> m_self;
+    };
+}
+
+// 所有future都就绪(成功或失败)后就绪。结果仍然通过各个future的get()读取
+template <class T>
+Future<void> whenAll(const std::vector<Future<T>>& futures)
+{
+    if(futures.empty())
+    {
+        std::shared_ptr<FutureState<void>> state = std::make_shared<FutureState<void>>();
+        state->setValue();
+        return Future<void>(state);
+    }
+
+    typedef detail::CombinatorState<void> State;
+    std::shared_ptr<State> state = State::create(futures, [](State* s, size_t)
+    {
+        if(s->readyCount() == s->inputCount())
+        {
+            s->setValue();
+        }
+    });
+    return Future<void>(state);
+}
+
+// 任意一个future就绪后就绪，结果是第一个就绪的future的下标
+template <class T>
+Future<size_t> whenAny(const std::vector<Future<T>>& futures)
+{
+    assert(!futures.empty());
+    typedef detail::CombinatorState<size_t> State;
+    std::shared_ptr<State> state = State::create(futures, [](State* s, size_t index)
+    {
+        if(s->claimFirst())
+        {
+            s->setValue(index);
+        }
+    });
+    return Future<size_t>(state);
+}
@@ -1,4 +1,9 @@
 #include "hook.h"
+#include "cancellation.h"
+#include "deadline.h"
+
+#include <chrono>
+#include <climits>
 
 
 
@@ -8,18 +13,38 @@
     XX(usleep) \
     XX(nanosleep) \
     XX(socket) \
+    XX(pipe) \
+    XX(pipe2) \
+    XX(eventfd) \
+    XX(timerfd_create) \
+    XX(signalfd) \
+    XX(open) \
+    XX(openat) \
+    XX(fsync) \
+    XX(fdatasync) \
     XX(connect) \
     XX(accept) \
+    XX(accept4) \
     XX(read) \
     XX(readv) \
     XX(recv) \
     XX(recvfrom) \
     XX(recvmsg) \
+    XX(recvmmsg) \
+    XX(pread) \
     XX(write) \
     XX(writev) \
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendmmsg) \
+    XX(pwrite) \
+    XX(sendfile) \
+    XX(splice) \
+    XX(poll) \
+    XX(ppoll) \
+    XX(select) \
+    XX(epoll_wait) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
@@ -79,6 +104,28 @@ struct timer_info
 };
 
 
+//普通文件无法用epoll等待，它的读写、fsync等操作交给阻塞线程池执行，当前协程挂起直到完成，
+//这样工作线程上的其他协程不会被磁盘IO卡住。errno在线程池中产生，需要带回当前线程。
+template<class Fn>
+static auto do_blocking(Fn fn) -> decltype(fn())
+{
+    Scheduler* scheduler = Scheduler::getThis();
+    if(!scheduler)
+    {
+        return fn();
+    }
+
+    int err = 0;
+    auto rt = scheduler->runBlocking([&fn, &err]()
+    {
+        auto r = fn();
+        err = errno;
+        return r;
+    });
+    errno = err;
+    return rt;
+}
+
 template<class OriginFun, class... Args>
 static ssize_t do_io(int fd, OriginFun fun, 
                         const char* hook_fun_name, 
@@ -104,8 +151,17 @@ static ssize_t do_io(int fd, OriginFun fun,
         return -1;
     }
 
-    //如果文件描述符不是一个socket或者用户设置了非阻塞模式，则直接调用原始的I/O操作函数。
-    if(!ctx->isSocket() || ctx->getUserNonblock())
+    //普通文件的读写交给阻塞线程池
+    if(ctx->isRegular())
+    {
+        return do_blocking([&]()
+        {
+            return fun(fd, std::forward<Args>(args)...);
+        });
+    }
+
+    //如果文件描述符不能被epoll等待或者用户设置了非阻塞模式，则直接调用原始的I/O操作函数。
+    if(!ctx->isPollable() || ctx->getUserNonblock())
     {
         return fun(fd, std::forward<Args>(args)...);
     }
@@ -146,14 +202,30 @@ retry:
     */
     if(n == -1 && errno == EAGAIN)
     {
+        //协程的取消令牌已经被取消，不再挂起
+        std::shared_ptr<CancellationToken> token = CancellationToken::getCurrent();
+        if(token && token->isCancelled())
+        {
+            errno = ECANCELED;
+            return -1;
+        }
+
+        //等待时间取fd的超时和请求截止时间剩余时间中的较小值，截止时间已过则直接超时
+        uint64_t wait_ms = std::min(timeout, DeadlineScope::getRemaining());
+        if(wait_ms == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
         IOManager* iom = IOManager::getThis();
         std::shared_ptr<Timer> timer;
         std::weak_ptr<timer_info> winfo(tinfo);
 
-        //如果执行的read等函数在Fdmanager管理的Fdctx中fd设置了超时时间，就会走到这里。添加addconditionTimer事件
-        if(timeout != (uint64_t)-1) //这行代码检查是否设置了超时时间。
+        //如果执行的read等函数在Fdmanager管理的Fdctx中fd设置了超时时间(或者协程有截止时间)，就会走到这里。添加addconditionTimer事件
+        if(wait_ms != (uint64_t)-1) //这行代码检查是否设置了超时时间。
         {
-            timer = iom->addConditionTimer(timeout, [winfo, fd, iom, event]()
+            timer = iom->addConditionTimer(wait_ms, [winfo, fd, iom, event]()
             {
                 auto t = winfo.lock();
                 if(!t || t->cancelled)  // 如果 timer_info 对象已被释放（!t），或者操作已被取消（t->cancelled 非 0），则直接返回。
@@ -165,7 +237,7 @@ retry:
                 //取消该文件描述符上的事件，并立即触发一次事件（即恢复被挂起的协程）
                 t->cancelled = ETIMEDOUT;
                 iom->cancelEvent(fd, (IOManager::Event)(event));
-            }, winfo);
+            }, winfo, false, true);
         }
 
 
@@ -183,8 +255,29 @@ retry:
         }
         else
         {
+            //令牌被取消时和超时一样取消事件，把协程唤醒
+            uint64_t cancel_cb = 0;
+            if(token)
+            {
+                cancel_cb = token->addCallback([winfo, fd, iom, event]()
+                {
+                    auto t = winfo.lock();
+                    if(!t || t->cancelled)
+                    {
+                        return;
+                    }
+                    t->cancelled = ECANCELED;
+                    iom->cancelEvent(fd, (IOManager::Event)(event));
+                });
+            }
+
             //如果 addEvent 成功（rt 为 0），当前协程会调用 yield() 函数，将自己挂起，等待事件的触发。
-            Fiber::getThis()->yield();
+            Fiber::getThisPtr()->yield();
+
+            if(token)
+            {
+                token->removeCallback(cancel_cb);
+            }
 
             //当协程被恢复时（例如，事件触发后），它会继续执行 yield() 之后的代码。
             //如果之前设置了定时器（timer 不为 nullptr），则在事件处理完毕后取消该定时器。取消定时器的原因是，
@@ -194,9 +287,9 @@ retry:
                 timer->cancel();
             }
 
-            //接下来检查 tinfo->cancelled 是否等于 ETIMEDOUT。如果等于，说明该操作因超时而被取消，
-            //因此设置 errno 为 ETIMEDOUT 并返回 -1，表示操作失败。
-            if(tinfo->cancelled == ETIMEDOUT)
+            //接下来检查 tinfo->cancelled 是否非0。如果是，说明该操作因超时(ETIMEDOUT)或取消令牌(ECANCELED)而被取消，
+            //因此设置 errno 并返回 -1，表示操作失败。
+            if(tinfo->cancelled)
             {
                 errno = tinfo->cancelled;
                 return -1;
@@ -208,6 +301,152 @@ retry:
     return n;
 }
 
+//poll系列hook挂起协程时的等待状态。一次等待会为多个fd登记事件并可能带一个超时定时器，
+//它们共享同一个poll_waiter，只有第一个到达的回调真正唤醒协程，其余的作废。
+struct poll_waiter
+{
+    std::atomic<bool> woken = {false};
+    FiberPtr fiber;
+    IOManager* iom = nullptr;
+
+    void wake()
+    {
+        if(!woken.exchange(true))
+        {
+            iom->scheduleLock(fiber, -1);
+        }
+    }
+};
+
+//poll/ppoll/select/epoll_wait的公共实现：先非阻塞地poll一次，没有就绪的fd则为每个fd登记IOManager事件
+//并挂起协程，被唤醒后再非阻塞地poll一次得到就绪集合。timeout_ms < 0 表示无限等待。
+static int do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms)
+{
+    //协程有截止时间时最多等待到截止时间，到期和普通超时一样返回0
+    uint64_t budget = DeadlineScope::getRemaining();
+    if(budget != ~0ull && (timeout_ms < 0 || (uint64_t)timeout_ms > budget))
+    {
+        timeout_ms = (int)std::min(budget, (uint64_t)INT_MAX);
+    }
+
+    int n = poll_f(fds, nfds, 0);
+    IOManager* iom = IOManager::getThis();
+    if(n != 0 || timeout_ms == 0 || !iom)
+    {
+        return n;
+    }
+
+    //无法登记事件的fd(例如同一个fd已有其他协程在等待)只能退化为定期轮询
+    static const int POLL_RETRY_MS = 10;
+
+    std::shared_ptr<CancellationToken> token = CancellationToken::getCurrent();
+    auto start = std::chrono::steady_clock::now();
+    while(true)
+    {
+        if(token && token->isCancelled())
+        {
+            errno = ECANCELED;
+            return -1;
+        }
+
+        int remaining = -1;
+        if(timeout_ms > 0)
+        {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            if(elapsed >= timeout_ms)
+            {
+                return 0;
+            }
+            remaining = timeout_ms - (int)elapsed;
+        }
+
+        std::shared_ptr<poll_waiter> waiter(new poll_waiter);
+        waiter->fiber = Fiber::getThis();
+        waiter->iom = iom;
+
+        std::vector<std::pair<int, IOManager::Event>> registered;
+        bool all_registered = true;
+        for(nfds_t i = 0; i < nfds; ++i)
+        {
+            if(fds[i].fd < 0)
+            {
+                continue;
+            }
+            if(fds[i].events & (POLLIN | POLLPRI | POLLRDNORM))
+            {
+                if(iom->addEvent(fds[i].fd, IOManager::READ, [waiter](){ waiter->wake(); }, true, waiter.get()) == 0)
+                {
+                    registered.push_back(std::make_pair(fds[i].fd, IOManager::READ));
+                }
+                else
+                {
+                    all_registered = false;
+                }
+            }
+            if(fds[i].events & (POLLOUT | POLLWRNORM))
+            {
+                if(iom->addEvent(fds[i].fd, IOManager::WRITE, [waiter](){ waiter->wake(); }, true, waiter.get()) == 0)
+                {
+                    registered.push_back(std::make_pair(fds[i].fd, IOManager::WRITE));
+                }
+                else
+                {
+                    all_registered = false;
+                }
+            }
+        }
+
+        int wait_ms = remaining;
+        if(!all_registered && (wait_ms < 0 || wait_ms > POLL_RETRY_MS))
+        {
+            wait_ms = POLL_RETRY_MS;
+        }
+
+        std::shared_ptr<Timer> timer;
+        if(wait_ms >= 0)
+        {
+            timer = iom->addTimer(wait_ms, [waiter](){ waiter->wake(); }, false, true);
+        }
+        //取消令牌和定时器一样只是唤醒协程，由循环开头返回ECANCELED
+        uint64_t cancel_cb = 0;
+        if(token)
+        {
+            cancel_cb = token->addCallback([waiter](){ waiter->wake(); });
+        }
+
+        //登记期间fd可能已经就绪(边缘触发不会再通知)，挂起前再检查一次。
+        //如果此时某个回调已经抢先把协程放入了调度队列，仍然需要yield一次把这次调度消费掉
+        n = poll_f(fds, nfds, 0);
+        if(n == 0 || waiter->woken.exchange(true))
+        {
+            Fiber::getThisPtr()->yield();
+        }
+
+        if(timer)
+        {
+            timer->cancel();
+        }
+        if(token)
+        {
+            token->removeCallback(cancel_cb);
+        }
+        //注销还没有触发的事件。已触发的事件可能已经被其他协程重新登记，按owner只删除自己的登记
+        for(auto& r : registered)
+        {
+            iom->delEvent(r.first, r.second, waiter.get());
+        }
+
+        if(n == 0)
+        {
+            n = poll_f(fds, nfds, 0);
+        }
+        if(n != 0)
+        {
+            return n;
+        }
+    }
+}
+
 extern "C"
 {
 
@@ -216,6 +455,81 @@ extern "C"
     HOOK_FUN(XX);
 #undef XX
 
+//挂起当前协程ms毫秒。当前协程的取消令牌被取消时提前返回false，errno为ECANCELED；
+//睡眠时间超过请求截止时间时只睡到截止时间，返回false，errno为ETIMEDOUT。remaining_ms返回没有睡完的时间
+static bool do_sleep(uint64_t ms, uint64_t* remaining_ms = nullptr)
+{
+    //获取当前正在执行的协程（Fiber），并将其保存到 fiber 变量中。
+    FiberPtr fiber = Fiber::getThis();
+    IOManager* iom = IOManager::getThis();
+    std::shared_ptr<CancellationToken> token = CancellationToken::getCurrent();
+    uint64_t sleep_ms = std::min(ms, DeadlineScope::getRemaining());
+
+    if(token && token->isCancelled())
+    {
+        if(remaining_ms)
+        {
+            *remaining_ms = ms;
+        }
+        errno = ECANCELED;
+        return false;
+    }
+
+    //定时器和取消令牌谁先触发谁唤醒协程，另一方作废
+    std::shared_ptr<std::atomic<int>> woken(new std::atomic<int>(0));
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<Timer> timer = iom->addTimer(sleep_ms, [woken, fiber, iom]()
+    {
+        int expected = 0;
+        if(woken->compare_exchange_strong(expected, ETIMEDOUT))
+        {
+            iom->scheduleLock(fiber, -1);
+        }
+    }, false, true);
+    uint64_t cancel_cb = 0;
+    if(token)
+    {
+        cancel_cb = token->addCallback([woken, fiber, iom]()
+        {
+            int expected = 0;
+            if(woken->compare_exchange_strong(expected, ECANCELED))
+            {
+                iom->scheduleLock(fiber, -1);
+            }
+        });
+    }
+    fiber->yield(); //挂起当前协程的执行，将控制权交还给调度器。
+
+    if(token)
+    {
+        token->removeCallback(cancel_cb);
+    }
+
+    int err = 0;
+    uint64_t slept = sleep_ms;
+    if(*woken == ECANCELED)
+    {
+        timer->cancel();
+        err = ECANCELED;
+        slept = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    else if(sleep_ms < ms)
+    {
+        err = ETIMEDOUT;
+    }
+    if(!err)
+    {
+        return true;
+    }
+
+    if(remaining_ms)
+    {
+        *remaining_ms = slept < ms ? ms - slept : 0;
+    }
+    errno = err;
+    return false;
+}
+
 unsigned int sleep(unsigned int seconds)
 {
     if(!t_hook_enable)
@@ -223,15 +537,12 @@ unsigned int sleep(unsigned int seconds)
         return sleep_f(seconds);
     }
 
-    //获取当前正在执行的协程（Fiber），并将其保存到 fiber 变量中。
-    std::shared_ptr<Fiber> fiber = Fiber::getThis();
-    IOManager* iom = IOManager::getThis();
-
-    iom->addTimer(seconds * 1000, [fiber, iom]()
+    //被取消或者到达截止时间时和被信号打断一样返回没有睡完的秒数
+    uint64_t remaining = 0;
+    if(!do_sleep((uint64_t)seconds * 1000, &remaining))
     {
-        iom->scheduleLock(fiber, -1);
-    });
-    fiber->yield(); //挂起当前协程的执行，将控制权交还给调度器。
+        return (remaining + 999) / 1000;
+    }
     return 0;
 }
 
@@ -244,14 +555,7 @@ int usleep(useconds_t usec)
 
     //useconds_t一个无符号整数类型，通常用于表示微秒数。
     //在这个函数中，usec表示延时的微秒数，将其转换为毫秒数(usec/1000)后用于定时器。
-    std::shared_ptr<Fiber> fiber = Fiber::getThis();
-    IOManager* iom = IOManager::getThis();
-    iom->addTimer(usec / 1000, [fiber, iom]()
-    {
-        iom->scheduleLock(fiber, -1);
-    });
-    fiber->yield();
-    return 0;
+    return do_sleep(usec / 1000) ? 0 : -1;
 }
 
 int nanosleep(const struct timespec* req, struct timespec* rem)
@@ -261,20 +565,26 @@ int nanosleep(const struct timespec* req, struct timespec* rem)
 		return nanosleep_f(req, rem);
 	}	
 
-	int timeout_ms = req->tv_sec*1000 + req->tv_nsec/1000/1000;
+	uint64_t timeout_ms = req->tv_sec*1000 + req->tv_nsec/1000/1000;
 
-	std::shared_ptr<Fiber> fiber = Fiber::getThis();
-	IOManager* iom = IOManager::getThis();
-	// add a timer to reschedule this fiber
-	iom->addTimer(timeout_ms, [fiber, iom](){iom->scheduleLock(fiber, -1);});
-	// wait for the next resume
-	fiber->yield();	
+	uint64_t remaining = 0;
+	if(!do_sleep(timeout_ms, &remaining))
+	{
+		if(rem)
+		{
+			rem->tv_sec = remaining / 1000;
+			rem->tv_nsec = (remaining % 1000) * 1000 * 1000;
+		}
+		return -1;
+	}
 	return 0;
 }
 
+//hook过的socket()会由FdCtx把fd设置为系统非阻塞(O_NONBLOCK)，这个状态属于内核中的打开文件，
+//fork/exec后子进程继承的socket同样是非阻塞的，pipe等其他交给FdManager管理的fd也一样，见pipe()前的说明
 int socket(int domain, int type, int protocol)
 {
-    if(t_hook_enable)
+    if(!t_hook_enable)
     {
         return socket_f(domain, type, protocol);
     }
@@ -291,6 +601,140 @@ int socket(int domain, int type, int protocol)
     return fd;
 }
 
+//pipe、eventfd、timerfd、signalfd和socket一样交给FdManager管理，FdCtx会把它们设置为非阻塞，
+//之后hook过的read/write在EAGAIN时挂起协程而不是阻塞整个线程。
+//注意：O_NONBLOCK是内核中打开文件的状态，和hook过的socket()一样，fork/exec后子进程继承的pipe端也是非阻塞的。
+//子进程没有hook，用户非阻塞标志对它不起作用，它的read/write会直接返回EAGAIN。
+//要把pipe交给子进程(例如作为子进程的标准输入输出)，在fork之前用fcntl清除O_NONBLOCK，
+//或者在关闭hook的线程中创建这个pipe
+int pipe(int pipefd[2])
+{
+    int rt = pipe_f(pipefd);
+    if(t_hook_enable && rt == 0)
+    {
+        fdMgr::getInstance().get(pipefd[0], true);
+        fdMgr::getInstance().get(pipefd[1], true);
+    }
+    return rt;
+}
+
+int pipe2(int pipefd[2], int flags)
+{
+    int rt = pipe2_f(pipefd, flags);
+    if(t_hook_enable && rt == 0)
+    {
+        fdMgr::getInstance().get(pipefd[0], true);
+        fdMgr::getInstance().get(pipefd[1], true);
+        if(flags & O_NONBLOCK)  //用户显式要求了非阻塞
+        {
+            fdMgr::getInstance().get(pipefd[0])->setUserNonblock(true);
+            fdMgr::getInstance().get(pipefd[1])->setUserNonblock(true);
+        }
+    }
+    return rt;
+}
+
+int eventfd(unsigned int initval, int flags)
+{
+    int fd = eventfd_f(initval, flags);
+    if(t_hook_enable && fd >= 0)
+    {
+        fdMgr::getInstance().get(fd, true)->setUserNonblock(flags & EFD_NONBLOCK);
+    }
+    return fd;
+}
+
+int timerfd_create(int clockid, int flags)
+{
+    int fd = timerfd_create_f(clockid, flags);
+    if(t_hook_enable && fd >= 0)
+    {
+        fdMgr::getInstance().get(fd, true)->setUserNonblock(flags & TFD_NONBLOCK);
+    }
+    return fd;
+}
+
+int signalfd(int fd, const sigset_t *mask, int flags)
+{
+    int rt = signalfd_f(fd, mask, flags);
+    if(t_hook_enable && rt >= 0 && fd == -1)   //fd != -1 时只是修改已有signalfd的信号集
+    {
+        fdMgr::getInstance().get(rt, true)->setUserNonblock(flags & SFD_NONBLOCK);
+    }
+    return rt;
+}
+
+//open/openat把打开的fd交给FdManager管理，普通文件的读写才能被识别出来交给阻塞线程池。
+//打开文件本身也可能因为磁盘元数据IO而阻塞，同样在阻塞线程池中执行。
+//FIFO和终端和pipe一样由FdCtx设置为非阻塞，调用者传入的O_NONBLOCK记录为用户非阻塞，读写在EAGAIN时直接返回而不挂起协程。
+int open(const char *pathname, int flags, ...)
+{
+    mode_t mode = 0;
+    //和glibc的__OPEN_NEEDS_MODE相同：O_TMPFILE包含O_DIRECTORY位，只打开目录时没有mode参数
+    if((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+    {
+        va_list va;
+        va_start(va, flags);
+        mode = va_arg(va, mode_t);
+        va_end(va);
+    }
+
+    if(!t_hook_enable)
+    {
+        return open_f(pathname, flags, mode);
+    }
+
+    int fd = do_blocking([=]() { return open_f(pathname, flags, mode); });
+    if(fd >= 0)
+    {
+        fdMgr::getInstance().get(fd, true)->setUserNonblock(flags & O_NONBLOCK);
+    }
+    return fd;
+}
+
+int openat(int dirfd, const char *pathname, int flags, ...)
+{
+    mode_t mode = 0;
+    //和glibc的__OPEN_NEEDS_MODE相同：O_TMPFILE包含O_DIRECTORY位，只打开目录时没有mode参数
+    if((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+    {
+        va_list va;
+        va_start(va, flags);
+        mode = va_arg(va, mode_t);
+        va_end(va);
+    }
+
+    if(!t_hook_enable)
+    {
+        return openat_f(dirfd, pathname, flags, mode);
+    }
+
+    int fd = do_blocking([=]() { return openat_f(dirfd, pathname, flags, mode); });
+    if(fd >= 0)
+    {
+        fdMgr::getInstance().get(fd, true)->setUserNonblock(flags & O_NONBLOCK);
+    }
+    return fd;
+}
+
+int fsync(int fd)
+{
+    if(!t_hook_enable)
+    {
+        return fsync_f(fd);
+    }
+    return do_blocking([=]() { return fsync_f(fd); });
+}
+
+int fdatasync(int fd)
+{
+    if(!t_hook_enable)
+    {
+        return fdatasync_f(fd);
+    }
+    return do_blocking([=]() { return fdatasync_f(fd); });
+}
+
 int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms)
 {
     if(!t_hook_enable)
@@ -328,6 +772,22 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return n;
     }
 
+    //协程的取消令牌已经被取消，不再等待连接完成
+    std::shared_ptr<CancellationToken> token = CancellationToken::getCurrent();
+    if(token && token->isCancelled())
+    {
+        errno = ECANCELED;
+        return -1;
+    }
+
+    //连接超时和请求截止时间取较小值
+    timeout_ms = std::min(timeout_ms, DeadlineScope::getRemaining());
+    if(timeout_ms == 0)
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
     IOManager* iom = IOManager::getThis();  //获取当前线程的 IOManager 实例。
     std::shared_ptr<Timer> timer;   //声明一个定时器对象。
     std::shared_ptr<timer_info> tinfo(new timer_info);  //创建追踪定时器是否取消的对象
@@ -345,18 +805,38 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
             }
             t->cancelled = ETIMEDOUT;
             iom->cancelEvent(fd, IOManager::WRITE);
-        }, winfo);
+        }, winfo, false, true);
     }
 
     int rt = iom->addEvent(fd, IOManager::WRITE);   //为文件描述符 fd 添加一个写事件监听器。这样的目的是为了上面的回调函数处理指定文件描述符
     if(rt == 0)
     {
-        Fiber::getThis()->yield();
+        //令牌被取消时和超时一样取消写事件，把协程唤醒
+        uint64_t cancel_cb = 0;
+        if(token)
+        {
+            cancel_cb = token->addCallback([winfo, fd, iom]()
+            {
+                auto t = winfo.lock();
+                if(!t || t->cancelled)
+                {
+                    return;
+                }
+                t->cancelled = ECANCELED;
+                iom->cancelEvent(fd, IOManager::WRITE);
+            });
+        }
+
+        Fiber::getThisPtr()->yield();
         
         if(timer)
         {
             timer->cancel();    
         }
+        if(token)
+        {
+            token->removeCallback(cancel_cb);
+        }
 
         if(tinfo->cancelled)    //发生超时错误或者用户取消
         {
@@ -410,6 +890,17 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
 	return fd;
 }
 
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags)
+{
+	int fd = do_io(sockfd, accept4_f, "accept4", IOManager::READ, SO_RCVTIMEO, addr, addrlen, flags);
+	if(fd>=0)
+	{
+		//和pipe2、eventfd一样记录调用者要求的非阻塞，之后的读写在EAGAIN时直接返回
+		fdMgr::getInstance().get(fd, true)->setUserNonblock(flags & SOCK_NONBLOCK);
+	}
+	return fd;
+}
+
 ssize_t read(int fd, void *buf, size_t count)
 {
 	return do_io(fd, read_f, "read", IOManager::READ, SO_RCVTIMEO, buf, count);	
@@ -435,6 +926,18 @@ ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags)
 	return do_io(sockfd, recvmsg_f, "recvmsg", IOManager::READ, SO_RCVTIMEO, msg, flags);	
 }
 
+//一次唤醒尽可能多地取出数据报：非阻塞socket上recvmmsg返回当前已到达的所有数据报(最多vlen个)，
+//只有一个都没有时才挂起协程
+int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout)
+{
+	return do_io(sockfd, recvmmsg_f, "recvmmsg", IOManager::READ, SO_RCVTIMEO, msgvec, vlen, flags, timeout);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+	return do_io(fd, pread_f, "pread", IOManager::READ, SO_RCVTIMEO, buf, count, offset);
+}
+
 ssize_t write(int fd, const void *buf, size_t count)
 {
 	return do_io(fd, write_f, "write", IOManager::WRITE, SO_SNDTIMEO, buf, count);	
@@ -460,6 +963,229 @@ ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags)
 	return do_io(sockfd, sendmsg_f, "sendmsg", IOManager::WRITE, SO_SNDTIMEO, msg, flags);	
 }
 
+int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+	return do_io(sockfd, sendmmsg_f, "sendmmsg", IOManager::WRITE, SO_SNDTIMEO, msgvec, vlen, flags);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+	return do_io(fd, pwrite_f, "pwrite", IOManager::WRITE, SO_SNDTIMEO, buf, count, offset);
+}
+
+//sendfile只会阻塞在输出端的socket上
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+	return do_io(out_fd, sendfile_f, "sendfile", IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
+//检查fd当前是否就绪，就绪返回0，否则返回-1并设置errno为EAGAIN。作为do_io的操作函数时，do_io只负责等待fd就绪
+static ssize_t poll_ready(int fd, short events)
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	int rt = poll_f(&pfd, 1, 0);
+	if(rt == 0)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+	return rt > 0 ? 0 : -1;
+}
+
+//splice两端至少有一个是pipe，EAGAIN可能是因为输入端没有数据，也可能是因为输出端已满。
+//每次EAGAIN后检查两端的就绪状态，只等待没有就绪的一端：等待已经就绪的一端会被立即唤醒，协程空转。
+//两端都没有就绪时先等输入端，重试后仍然EAGAIN再等输出端
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags)
+{
+	//SPLICE_F_NONBLOCK表示调用者要求不阻塞
+	if(!t_hook_enable || (flags & SPLICE_F_NONBLOCK))
+	{
+		return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+	}
+
+	while(true)
+	{
+		ssize_t n = splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+		while(n == -1 && errno == EINTR)
+		{
+			n = splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+		}
+		if(n != -1 || errno != EAGAIN)
+		{
+			return n;
+		}
+
+		struct pollfd pfds[2];
+		pfds[0].fd = fd_in;
+		pfds[0].events = POLLIN;
+		pfds[0].revents = 0;
+		pfds[1].fd = fd_out;
+		pfds[1].events = POLLOUT;
+		pfds[1].revents = 0;
+		poll_f(pfds, 2, 0);
+
+		//两端都已经就绪(检查前状态刚刚改变)，直接重试
+		ssize_t rt = 0;
+		if(!pfds[0].revents)
+		{
+			rt = do_io(fd_in, poll_ready, "splice", IOManager::READ, SO_RCVTIMEO, (short)POLLIN);
+		}
+		else if(!pfds[1].revents)
+		{
+			rt = do_io(fd_out, poll_ready, "splice", IOManager::WRITE, SO_SNDTIMEO, (short)POLLOUT);
+		}
+
+		//等待的一端不能被挂起等待(用户非阻塞、不能用epoll等待)时返回EAGAIN，超时或者被取消时返回对应的错误
+		if(rt == -1)
+		{
+			return -1;
+		}
+	}
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	if(!t_hook_enable)
+	{
+		return poll_f(fds, nfds, timeout);
+	}
+	return do_poll(fds, nfds, timeout);
+}
+
+int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask)
+{
+	//临时替换信号掩码的语义无法在挂起协程期间保持，带sigmask的调用保持原样
+	if(!t_hook_enable || sigmask)
+	{
+		return ppoll_f(fds, nfds, tmo_p, sigmask);
+	}
+
+	//不足1毫秒的部分向上取整，和内核一样：向下取整会把很短的阻塞等待变成不等待的轮询
+	int timeout_ms = -1;
+	if(tmo_p)
+	{
+		timeout_ms = tmo_p->tv_sec * 1000 + (tmo_p->tv_nsec + 999999) / 1000000;
+	}
+	return do_poll(fds, nfds, timeout_ms);
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+	if(!t_hook_enable)
+	{
+		return select_f(nfds, readfds, writefds, exceptfds, timeout);
+	}
+
+	//把三个fd_set转换成pollfd数组
+	std::vector<struct pollfd> pfds;
+	for(int fd = 0; fd < nfds; ++fd)
+	{
+		short events = 0;
+		if(readfds && FD_ISSET(fd, readfds))
+		{
+			events |= POLLIN;
+		}
+		if(writefds && FD_ISSET(fd, writefds))
+		{
+			events |= POLLOUT;
+		}
+		if(exceptfds && FD_ISSET(fd, exceptfds))
+		{
+			events |= POLLPRI;
+		}
+		if(events)
+		{
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = events;
+			pfd.revents = 0;
+			pfds.push_back(pfd);
+		}
+	}
+
+	//不足1毫秒的部分向上取整，同ppoll
+	int timeout_ms = -1;
+	if(timeout)
+	{
+		timeout_ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+	}
+
+	int rt = do_poll(pfds.data(), pfds.size(), timeout_ms);
+	if(rt < 0)
+	{
+		return rt;
+	}
+
+	//再把就绪结果写回fd_set，select的返回值是三个集合中置位的总数
+	if(readfds)
+	{
+		FD_ZERO(readfds);
+	}
+	if(writefds)
+	{
+		FD_ZERO(writefds);
+	}
+	if(exceptfds)
+	{
+		FD_ZERO(exceptfds);
+	}
+
+	int count = 0;
+	for(auto& pfd : pfds)
+	{
+		if(pfd.revents & POLLNVAL)
+		{
+			errno = EBADF;
+			return -1;
+		}
+		if(readfds && (pfd.events & POLLIN) && (pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+		{
+			FD_SET(pfd.fd, readfds);
+			++count;
+		}
+		if(writefds && (pfd.events & POLLOUT) && (pfd.revents & (POLLOUT | POLLERR)))
+		{
+			FD_SET(pfd.fd, writefds);
+			++count;
+		}
+		if(exceptfds && (pfd.events & POLLPRI) && (pfd.revents & POLLPRI))
+		{
+			FD_SET(pfd.fd, exceptfds);
+			++count;
+		}
+	}
+	return count;
+}
+
+//嵌套的epoll：epfd本身在有事件就绪时可读，所以等待它可读后再非阻塞地取出事件
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+	if(!t_hook_enable || timeout == 0)
+	{
+		return epoll_wait_f(epfd, events, maxevents, timeout);
+	}
+
+	int n = epoll_wait_f(epfd, events, maxevents, 0);
+	if(n != 0)
+	{
+		return n;
+	}
+
+	struct pollfd pfd;
+	pfd.fd = epfd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	int rt = do_poll(&pfd, 1, timeout);
+	if(rt <= 0)
+	{
+		return rt;
+	}
+	return epoll_wait_f(epfd, events, maxevents, 0);
+}
+
 int close(int fd)
 {
 	if(!t_hook_enable)
@@ -494,7 +1220,7 @@ int fcntl(int fd, int cmd, ... /* arg */ )
                 int arg = va_arg(va, int); // Access the next int argument
                 va_end(va);
                 std::shared_ptr<FdCtx> ctx = fdMgr::getInstance().get(fd);
-                if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
+                if(!ctx || ctx->isClosed() || !ctx->isPollable()) 
                 {
                     return fcntl_f(fd, cmd, arg);
                 }
@@ -519,7 +1245,7 @@ int fcntl(int fd, int cmd, ... /* arg */ )
                 va_end(va);
                 int arg = fcntl_f(fd, cmd);
                 std::shared_ptr<FdCtx> ctx = fdMgr::getInstance().get(fd);
-                if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
+                if(!ctx || ctx->isClosed() || !ctx->isPollable()) 
                 {
                     return arg;
                 }
@@ -602,7 +1328,7 @@ int ioctl(int fd, unsigned long request, ...)
     {
         bool user_nonblock = !!*(int*)arg;
         std::shared_ptr<FdCtx> ctx = fdMgr::getInstance().get(fd);
-        if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
+        if(!ctx || ctx->isClosed() || !ctx->isPollable()) 
         {
             return ioctl_f(fd, request, arg);
         }
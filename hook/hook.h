@@ -6,6 +6,13 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
 #include <fcntl.h>
 #include <dlfcn.h>
 #include <iostream>
@@ -35,12 +42,42 @@ extern "C"//确保正确调用c库中的系统调用，c++编译器不会对这
     typedef int (*socket_fun) (int domain, int type, int protocol);
     extern socket_fun socket_f;
 
+    typedef int (*pipe_fun) (int pipefd[2]);
+    extern pipe_fun pipe_f;
+
+    typedef int (*pipe2_fun) (int pipefd[2], int flags);
+    extern pipe2_fun pipe2_f;
+
+    typedef int (*eventfd_fun) (unsigned int initval, int flags);
+    extern eventfd_fun eventfd_f;
+
+    typedef int (*timerfd_create_fun) (int clockid, int flags);
+    extern timerfd_create_fun timerfd_create_f;
+
+    typedef int (*signalfd_fun) (int fd, const sigset_t *mask, int flags);
+    extern signalfd_fun signalfd_f;
+
+    typedef int (*open_fun) (const char *pathname, int flags, ...);
+    extern open_fun open_f;
+
+    typedef int (*openat_fun) (int dirfd, const char *pathname, int flags, ...);
+    extern openat_fun openat_f;
+
+    typedef int (*fsync_fun) (int fd);
+    extern fsync_fun fsync_f;
+
+    typedef int (*fdatasync_fun) (int fd);
+    extern fdatasync_fun fdatasync_f;
+
     typedef int (*connect_fun) (int sockfd, const struct sockaddr *addr, socklen_t addrlen);
     extern connect_fun connect_f;
 
     typedef int (*accept_fun) (int sockfd, struct sockaddr *addr, socklen_t *addrlen);
     extern accept_fun accept_f;
 
+    typedef int (*accept4_fun) (int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+    extern accept4_fun accept4_f;
+
     typedef ssize_t (*read_fun) (int fd, void *buf, size_t count);
     extern read_fun read_f;
 
@@ -55,6 +92,12 @@ extern "C"//确保正确调用c库中的系统调用，c++编译器不会对这
 
     typedef ssize_t (*recvmsg_fun) (int sockfd, struct msghdr *msg, int flags);  extern recvmsg_fun recvmsg_f;
 
+    typedef int (*recvmmsg_fun) (int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout);
+    extern recvmmsg_fun recvmmsg_f;
+
+    typedef ssize_t (*pread_fun) (int fd, void *buf, size_t count, off_t offset);
+    extern pread_fun pread_f;
+
     typedef ssize_t (*write_fun) (int fd, const void *buf, size_t count);
     extern write_fun write_f;
       typedef ssize_t (*writev_fun) (int fd, const struct iovec *iov, int iovcnt);
@@ -69,6 +112,30 @@ extern "C"//确保正确调用c库中的系统调用，c++编译器不会对这
     typedef ssize_t (*sendmsg_fun) (int sockfd, const struct msghdr *msg, int flags);
     extern sendmsg_fun sendmsg_f;
 
+    typedef int (*sendmmsg_fun) (int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+    extern sendmmsg_fun sendmmsg_f;
+
+    typedef ssize_t (*pwrite_fun) (int fd, const void *buf, size_t count, off_t offset);
+    extern pwrite_fun pwrite_f;
+
+    typedef ssize_t (*sendfile_fun) (int out_fd, int in_fd, off_t *offset, size_t count);
+    extern sendfile_fun sendfile_f;
+
+    typedef ssize_t (*splice_fun) (int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags);
+    extern splice_fun splice_f;
+
+    typedef int (*poll_fun) (struct pollfd *fds, nfds_t nfds, int timeout);
+    extern poll_fun poll_f;
+
+    typedef int (*ppoll_fun) (struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask);
+    extern ppoll_fun ppoll_f;
+
+    typedef int (*select_fun) (int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+    extern select_fun select_f;
+
+    typedef int (*epoll_wait_fun) (int epfd, struct epoll_event *events, int maxevents, int timeout);
+    extern epoll_wait_fun epoll_wait_f;
+
     typedef int (*close_fun) (int fd);
     extern close_fun close_f;
 
@@ -96,6 +163,15 @@ extern "C"//确保正确调用c库中的系统调用，c++编译器不会对这
     int socket(int domain, int type, int protocol);
     int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
     int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+    int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+
+    // other pollable fds
+    // 注意：hook打开时创建的pipe/socket等在内核中被设置为O_NONBLOCK，fork/exec后子进程继承到的也是非阻塞的
+    int pipe(int pipefd[2]);
+    int pipe2(int pipefd[2], int flags);
+    int eventfd(unsigned int initval, int flags);
+    int timerfd_create(int clockid, int flags);
+    int signalfd(int fd, const sigset_t *mask, int flags);
 
     // read
     ssize_t read(int fd, void *buf, size_t count);
@@ -104,6 +180,8 @@ extern "C"//确保正确调用c库中的系统调用，c++编译器不会对这
     ssize_t recv(int sockfd, void *buf, size_t len, int flags);
     ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen);
     ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags);
+    int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout);
+    ssize_t pread(int fd, void *buf, size_t count, off_t offset);
 
 
     // write
@@ -113,6 +191,24 @@ extern "C"//确保正确调用c库中的系统调用，c++编译器不会对这
     ssize_t send(int sockfd, const void *buf, size_t len, int flags);
     ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen);
     ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags);
+    int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+    ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
+
+    // zero copy
+    ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+    ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags);
+
+    // multiplexing
+    int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+    int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask);
+    int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+    int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+    // regular file
+    int open(const char *pathname, int flags, ...);
+    int openat(int dirfd, const char *pathname, int flags, ...);
+    int fsync(int fd);
+    int fdatasync(int fd);
 
     // fd
     int close(int fd);
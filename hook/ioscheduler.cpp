@@ -1,4 +1,5 @@
 #include "ioscheduler.h"
+#include "fdmanager.h"
 
 static bool debug = false;
 
@@ -8,7 +9,9 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string &name) :
     m_epfd = epoll_create(5000);
     assert(m_epfd > 0);
 
-    int rt = pipe(m_tickle_fds);    //创建管道的函数规定了m_tickleFds[0]是读端，1是写端
+    //创建管道的函数规定了m_tickleFds[0]是读端，1是写端。
+    //使用原始的pipe，调度器内部的管道不交给FdManager管理，tickle()/idle()里的读写不能挂起协程
+    int rt = pipe_f(m_tickle_fds);
     assert(!rt);
 
     //将管道的监听注册到epoll上
@@ -48,7 +51,7 @@ IOManager::~IOManager()
     }
 }
 
-int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
+int IOManager::addEvent(int fd, Event event, TaskFn cb, bool run_inline, const void* owner)
 {
     //查找FdContext对象
     FdContext* fd_ctx = nullptr;
@@ -78,14 +81,16 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
     //如果已经存在就fd_ctx->events本身已经有读或写，就是修改已经有事件，如果不存在就是none事件的情况，就添加事件。
     int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
     epoll_event epevent;
-    epevent.events = EPOLLET | fd_ctx->events | event;
+    epevent.events = (uint32_t)EPOLLET | fd_ctx->events | event;
     epevent.data.ptr = fd_ctx;
 
     //将事件添加到 epoll 中
     int rt = epoll_ctl(m_epfd, op, fd, &epevent);
     if(rt)
     {
+        //例如普通文件不支持epoll(EPERM)或fd无效(EBADF)，此时不能登记事件，否则该事件永远不会被触发
         std::cerr << "addEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
+        return -1;
     }
 
     ++m_pending_event_count;    //原子计数器，待处理的事件++；
@@ -95,11 +100,13 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
     FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
     assert(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb);//确保 EventContext 中没有其他正在执行的调度器、协程或回调函数。
     event_ctx.scheduler = Scheduler::getThis();//设置调度器为当前的调度器实例（Scheduler::GetThis()）。
+    event_ctx.owner = owner;
     //如果提供了回调函数 cb，则将其保存到 EventContext 中；否则，将当前正在运行的协程保存到 EventContext 中，
     //并确保协程的状态是正在运行。
     if(cb)
     {
         event_ctx.cb.swap(cb);
+        event_ctx.run_inline = run_inline;
     
     }
     else
@@ -111,7 +118,7 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
     return 0;
 }
 
-bool IOManager::delEvent(int fd, Event event)
+bool IOManager::delEvent(int fd, Event event, const void* owner)
 {
     //和添加事件类似
     FdContext* fd_ctx = nullptr;
@@ -134,11 +141,15 @@ bool IOManager::delEvent(int fd, Event event)
     {
         return false;
     }
+    if(owner && fd_ctx->getEventContext(event).owner != owner)
+    {
+        return false;
+    }
 
     Event new_events = (Event)(fd_ctx->events & ~event);
     int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
     epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
+    epevent.events = (uint32_t)EPOLLET | new_events;
     epevent.data.ptr = fd_ctx;  //这一步是为了在 epoll 事件触发时能够快速找到与该事件相关联的 FdContext 对象
 
     int rt = epoll_ctl(m_epfd, op, fd, &epevent);
@@ -186,7 +197,7 @@ bool IOManager::cancelEvent(int fd, Event event)
     Event new_events = (Event)(fd_ctx->events & ~event);
     int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
     epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
+    epevent.events = (uint32_t)EPOLLET | new_events;
     epevent.data.ptr = fd_ctx;
 
     int rt = epoll_ctl(m_epfd, op, fd, &epevent);
@@ -256,11 +267,171 @@ bool IOManager::cancelAll(int fd)
     return true;
 }
 
+int IOManager::addAcceptor(int listen_fd, std::function<void(int)> cb, size_t batch_size)
+{
+    assert(cb && batch_size > 0);
+
+    std::shared_ptr<Acceptor> acceptor(new Acceptor);
+    acceptor->fd = listen_fd;
+    acceptor->batch_size = batch_size;
+    acceptor->cb.swap(cb);
+
+    {
+        std::lock_guard<std::mutex> lock(m_acceptor_mutex);
+        if(m_acceptors.count(listen_fd))    //同一个监听socket不能重复注册
+        {
+            return -1;
+        }
+        m_acceptors[listen_fd] = acceptor;
+    }
+
+    //accept4必须工作在非阻塞模式下才能在取空backlog时以EAGAIN结束
+    int flags = fcntl_f(listen_fd, F_GETFL, 0);
+    if(!(flags & O_NONBLOCK))
+    {
+        fcntl_f(listen_fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    //先主动取一次，处理注册前已经在backlog中的连接，随后由onAcceptable注册读事件
+    scheduleLock(std::function<void()>(std::bind(&IOManager::onAcceptable, this, acceptor)));
+    return 0;
+}
+
+bool IOManager::delAcceptor(int listen_fd)
+{
+    std::shared_ptr<Acceptor> acceptor;
+    {
+        std::lock_guard<std::mutex> lock(m_acceptor_mutex);
+        auto it = m_acceptors.find(listen_fd);
+        if(it == m_acceptors.end())
+        {
+            return false;
+        }
+        acceptor = it->second;
+        m_acceptors.erase(it);
+    }
+
+    acceptor->stopped = true;
+    delEvent(listen_fd, READ);
+    return true;
+}
+
+void IOManager::onAcceptable(std::shared_ptr<Acceptor> acceptor)
+{
+    if(acceptor->stopped)
+    {
+        return;
+    }
+
+    std::vector<int> batch;
+    batch.reserve(acceptor->batch_size);
+
+    //把攒够的一批fd作为一个任务交给工作线程，一次加锁入队代替每个连接一次
+    auto flush = [this, &batch, &acceptor]()
+    {
+        if(batch.empty())
+        {
+            return;
+        }
+        std::vector<int> fds;
+        fds.swap(batch);
+        batch.reserve(acceptor->batch_size);
+
+        std::function<void(int)> cb = acceptor->cb;
+        scheduleLock(std::function<void()>([cb, fds]()
+        {
+            for(int fd : fds)
+            {
+                cb(fd);
+            }
+        }));
+    };
+
+    bool rearm_later = false;
+    //直接调用原始的accept4：hook版本在EAGAIN时会挂起协程，而这里需要以EAGAIN作为取空backlog的信号
+    while(true)
+    {
+        int fd = accept4_f(acceptor->fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd >= 0)
+        {
+            //新连接已经是非阻塞的，交给FdManager管理后hook过的recv/send才能挂起协程
+            fdMgr::getInstance().get(fd, true);
+            batch.push_back(fd);
+            if(batch.size() >= acceptor->batch_size)
+            {
+                flush();
+            }
+            continue;
+        }
+
+        //被信号打断或者连接在accept前已被对端重置，继续取下一个
+        if(errno == EINTR || errno == ECONNABORTED)
+        {
+            continue;
+        }
+        //backlog已经取空
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break;
+        }
+
+        //EMFILE/ENFILE/ENOBUFS/ENOMEM：资源暂时耗尽，backlog中还有连接，但是立即重新注册读事件会因为边缘触发的初始就绪而空转，稍后再试
+        if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+        {
+            if(debug) std::cout << "IOManager::onAcceptable accept4 failed: " << strerror(errno) << ", retry later" << std::endl;
+            rearm_later = true;
+            break;
+        }
+
+        //EBADF/ENOTSOCK/EINVAL等：监听socket已经关闭或者无效，重试也不会成功，注销acceptor
+        if(debug) std::cout << "IOManager::onAcceptable accept4 failed: " << strerror(errno) << ", stop accepting" << std::endl;
+        flush();
+        {
+            //fd可能已经被关闭后复用并注册了新的acceptor，只注销自己
+            std::lock_guard<std::mutex> lock(m_acceptor_mutex);
+            auto it = m_acceptors.find(acceptor->fd);
+            if(it != m_acceptors.end() && it->second == acceptor)
+            {
+                m_acceptors.erase(it);
+            }
+        }
+        acceptor->stopped = true;
+        return;
+    }
+    flush();
+
+    if(acceptor->stopped)
+    {
+        return;
+    }
+
+    if(rearm_later)
+    {
+        addTimer(100, [this, acceptor]()
+        {
+            scheduleLock(std::function<void()>(std::bind(&IOManager::onAcceptable, this, acceptor)));
+        });
+    }
+    else
+    {
+        addEvent(acceptor->fd, READ, std::bind(&IOManager::onAcceptable, this, acceptor));
+    }
+}
+
 IOManager *IOManager::getThis()
 {
     return dynamic_cast<IOManager*>(Scheduler::getThis());
 }
 
+void IOManager::run()
+{
+    //hook的开关是线程局部的。use_caller时调用者线程也会进入这里，退出后还原它原来的设置
+    bool hook_enable = is_hook_enable();
+    set_hook_enable(true);
+    Scheduler::run();
+    set_hook_enable(hook_enable);
+}
+
 void IOManager::tickle()
 {
     if(!hasIdleThreads())
@@ -291,7 +462,8 @@ void IOManager::idle()
     while(true)
     {
         if(debug) std::cout << "IOManger::idle(), run in thread: " << Thread::getThreadId() << std::endl;
-        if(stopping())
+        //调度器停止，或者弹性线程池回收当前线程
+        if(stopping() || shouldRetire())
         {
             if(debug) std::cout << "name = " << getName() << " idle exists in thread: " << Thread::getThreadId() << std::endl;  
             break;
@@ -304,10 +476,13 @@ void IOManager::idle()
             uint64_t next_timeout = getNextTimer();
             //获取下一个定时器的超时时间，并将其与 MAX_TIMEOUT 取较小值，避免等待时间过长。
             next_timeout = std::min(next_timeout, MAX_TIMEOUT);
+            //上次取任务时跳过了留给其他线程的任务，最多等到它可以被当前线程取走
+            next_timeout = std::min(next_timeout, getRetryTimeout());
 
             //epoll_wait陷入阻塞，等待tickle信号的唤醒，
             //并且使用了定时器堆中最早超时的定时器作为epoll_wait超时时间。
-            rt = epoll_wait(m_epfd, events.get(), MAX_EVENTS, (int)next_timeout);
+            //必须调用原始的epoll_wait：hook版本会把调度线程自己的等待也变成挂起协程
+            rt = epoll_wait_f(m_epfd, events.get(), MAX_EVENTS, (int)next_timeout);
             if(rt < 0 && errno == EINTR)    //rt小于0代表无限阻塞，errno是EINTR(表示信号中断)则继续等待
             {
                 continue;
@@ -318,13 +493,19 @@ void IOManager::idle()
             }
         }
 
-        std::vector<std::function<void()>> cbs; //用于存储超时的回调函数。
-        listExpiredCb(cbs); //用来获取所有超时的定时器回调，并将它们添加到 cbs中。
+        std::vector<TaskFn> cbs; //用于存储超时的回调函数。
+        std::vector<TaskFn> inline_cbs;
+        listExpiredCb(cbs, &inline_cbs); //用来获取所有超时的定时器回调，并将它们添加到 cbs中。
+        //不会阻塞的回调(例如hook中唤醒sleep的协程)直接在空闲协程中执行，不创建协程
+        for(auto& cb : inline_cbs)
+        {
+            cb();
+        }
         if(!cbs.empty())
         {
-            for(const auto& cb : cbs)
+            for(auto& cb : cbs)
             {
-                scheduleLock(cb);
+                scheduleLock(std::move(cb));
             }
             cbs.clear();
         }
@@ -396,7 +577,7 @@ void IOManager::idle()
             }
         }
         //当前线程的协程主动让出控制权，调度器可以选择执行其他任务或再次进入 idle 状态。
-        Fiber::getThis()->yield();
+        Fiber::getThisPtr()->yield();
     }
 }
 
@@ -439,6 +620,8 @@ void IOManager::FdContext::resetEventContext(EventContext &ctx)
     ctx.scheduler = nullptr;
     ctx.fiber.reset();
     ctx.cb = nullptr;
+    ctx.run_inline = false;
+    ctx.owner = nullptr;
 }
 
 void IOManager::FdContext::triggerEvent(Event event)
@@ -451,9 +634,13 @@ void IOManager::FdContext::triggerEvent(Event event)
 
     EventContext& ctx = getEventContext(event);
     //把真正要执行的函数放入到任务队列中等线程取出后任务后，协程执行，执行完成后返回主协程继续，执行run方法取任务执行任务
-    if(ctx.cb)
+    if(ctx.cb && ctx.run_inline)
+    {
+        ctx.scheduler->scheduleInline(std::move(ctx.cb));
+    }
+    else if(ctx.cb)
     {
-        ctx.scheduler->scheduleLock(ctx.cb);
+        ctx.scheduler->scheduleLock(std::move(ctx.cb));
     }
     else
     {
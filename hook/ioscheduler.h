@@ -7,6 +7,7 @@
 #include <string>
 #include <cstring>
 #include <unistd.h>
+#include <unordered_map>
 
 // 1 注册事件 -> 2 等待事件 -> 3 事件触发调度回调 -> 4 注销事件回调后从epoll注销 -> 5 执行回调进入调度器中执行调度。
 class IOManager : public Scheduler, public TimerManager
@@ -29,9 +30,11 @@ private:
             //scheduler
             Scheduler* scheduler = nullptr; //关联的调度器。
             //callback fiber
-            std::shared_ptr<Fiber> fiber;   //关联的回调线程（协程）。
+            FiberPtr fiber;   //关联的回调线程（协程）。
             //callback function
-            std::function<void()> cb;   //关联的回调函数。
+            TaskFn cb;   //关联的回调函数。
+            bool run_inline = false;    //cb不会阻塞，触发时直接在调度协程上执行
+            const void* owner = nullptr;    //登记者的标识，delEvent据此只删除自己的登记
         };
 
         //read event context
@@ -54,17 +57,30 @@ public:
 
     //事件管理方法
     //添加一个事件到文件描述符 fd 上，并关联一个回调函数 cb。
-    int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
-    //删除文件描述符fd上的某个事件
-    bool delEvent(int fd, Event event);
+    //run_inline表示cb很短且不会阻塞或挂起协程，触发时不为它创建协程(见Scheduler::scheduleInline)
+    //owner标识登记者，配合delEvent的owner使用
+    int addEvent(int fd, Event event, TaskFn cb = nullptr, bool run_inline = false, const void* owner = nullptr);
+    //删除文件描述符fd上的某个事件。
+    //owner不为空时只删除由它登记的事件：自己的事件触发之后，同一个fd/事件可能已经被别人重新登记
+    bool delEvent(int fd, Event event, const void* owner = nullptr);
     //取消文件描述符上的某个事件，并触发其回调函数
     bool cancelEvent(int fd, Event event);
     //取消文件描述符 fd 上的所有事件，并触发所有回调函数。
     bool cancelAll(int fd);
 
+    //注册监听socket。每次可读时用accept4循环取出backlog中的所有连接直到EAGAIN，
+    //并按batch_size个一批调度到工作线程，同一批中的fd在一个任务里依次交给cb处理。
+    //cb应当尽快返回（例如只为新连接addEvent），需要阻塞的处理逻辑请自行scheduleLock。
+    int addAcceptor(int listen_fd, std::function<void(int)> cb, size_t batch_size = 32);
+    //注销监听socket，之后不会再为其accept新连接
+    bool delAcceptor(int listen_fd);
+
     static IOManager* getThis();
 
 protected:
+    //在每个调度线程上开启hook后进入Scheduler::run，任务和恢复的协程无论在哪个线程执行都走hook版本的系统调用
+    void run() override;
+
     //通知调度器有任务调度
     //写pipe让idle协程从epoll_wait退出，待idle协程yield之后Scheduler::run就可以调度其他任务.
     void tickle() override;
@@ -83,6 +99,18 @@ protected:
     //调整文件描述符上下文数组的大小。
     void contextResize(size_t size);
 
+private:
+    struct Acceptor     //描述一个由IOManager接管的监听socket
+    {
+        int fd = -1;
+        size_t batch_size = 32;
+        std::function<void(int)> cb;    //每个新连接的处理函数
+        std::atomic<bool> stopped = {false};
+    };
+
+    //监听socket可读时的回调：一次性取空backlog，再重新注册读事件
+    void onAcceptable(std::shared_ptr<Acceptor> acceptor);
+
 private:
     int m_epfd = 0; //用于epoll的文件描述符。
 
@@ -94,6 +122,9 @@ private:
 
     std::vector<FdContext*> m_fd_contexts;  //文件描述符上下文数组，用于存储每个文件描述符的 FdContext。
 
+    std::mutex m_acceptor_mutex;
+    std::unordered_map<int, std::shared_ptr<Acceptor>> m_acceptors;  //listen fd -> Acceptor
+
 };
 
 
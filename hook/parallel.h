@@ -0,0 +1,224 @@
+#pragma once
+
+#include "scheduler.h"
+#include "taskgroup.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <exception>
+
+// 调度器上的fork-join并行算法：把计算切成分块交给调度器的工作线程，和IO协程共用同一组线程，不再额外创建线程争抢CPU。
+// 调用者(协程或普通线程)也领取分块一起计算，领取完后只等待其他线程正在执行的分块，
+// 因此在工作线程的协程中调用、或者嵌套调用时也不会因为所有线程都在等待而死锁。
+// 分块通过原子计数动态领取，执行快的线程多领，grain为0时按线程数自动选择分块大小。
+// 任何分块抛出异常时跳过剩余分块，在调用者中重新抛出第一个异常。
+// 计算中应当定期调用Fiber::maybeYield()，否则长时间占用工作线程会推迟IO协程的执行。
+
+namespace detail
+{
+    //参与计算的线程数：调度器的工作线程加上调用者
+    inline size_t parallelWorkers(Scheduler* scheduler)
+    {
+        return scheduler ? scheduler->getThreadCount() + 1 : 1;
+    }
+
+    //每个线程大约分到8个分块，执行时间不均匀时也能负载均衡
+    inline size_t parallelGrain(size_t n, size_t grain, Scheduler* scheduler)
+    {
+        if(grain == 0)
+        {
+            grain = n / (parallelWorkers(scheduler) * 8);
+        }
+        return std::max<size_t>(grain, 1);
+    }
+
+    //执行run_chunk(0) ... run_chunk(chunks - 1)，返回时所有分块都已经执行完毕
+    template <class ChunkFn>
+    void forkJoin(size_t chunks, ChunkFn& run_chunk, Scheduler* scheduler)
+    {
+        if(chunks == 0)
+        {
+            return;
+        }
+        size_t helpers = std::min(chunks, parallelWorkers(scheduler)) - 1;
+        if(helpers == 0)
+        {
+            for(size_t i = 0; i < chunks; ++i)
+            {
+                run_chunk(i);
+            }
+            return;
+        }
+
+        //调用者返回后，排队较晚的辅助任务可能才开始执行，共享状态由它们一起持有。
+        //它们领取不到分块，不会再访问调用者栈上的run_chunk
+        struct State
+        {
+            std::atomic<size_t> next = {0};
+            size_t chunks = 0;
+            ChunkFn* run_chunk = nullptr;
+            WaitGroup wg;
+            std::atomic<bool> failed = {false};
+            std::exception_ptr eptr;
+            std::mutex mutex;
+
+            void work()
+            {
+                size_t i;
+                while((i = next.fetch_add(1, std::memory_order_relaxed)) < chunks)
+                {
+                    if(!failed.load(std::memory_order_relaxed))
+                    {
+                        try
+                        {
+                            (*run_chunk)(i);
+                        }
+                        catch(...)
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            if(!failed.exchange(true))
+                            {
+                                eptr = std::current_exception();
+                            }
+                        }
+                    }
+                    wg.done();
+                }
+            }
+        };
+
+        std::shared_ptr<State> state = std::make_shared<State>();
+        state->chunks = chunks;
+        state->run_chunk = &run_chunk;
+        state->wg.add((int)chunks);
+        for(size_t i = 0; i < helpers; ++i)
+        {
+            scheduler->scheduleLock([state]()
+            {
+                state->work();
+            });
+        }
+
+        //调用者也参与计算，领取完后等待其他线程正在执行的分块
+        state->work();
+        state->wg.wait();
+
+        if(state->eptr)
+        {
+            std::rethrow_exception(state->eptr);
+        }
+    }
+}
+
+// 对[begin, end)中的每个下标并行执行fn(i)
+template <class Index, class Fn>
+void parallel_for(Index begin, Index end, Fn fn, size_t grain = 0, Scheduler* scheduler = Scheduler::getThis())
+{
+    if(!(begin < end))
+    {
+        return;
+    }
+    size_t n = (size_t)(end - begin);
+    grain = detail::parallelGrain(n, grain, scheduler);
+    size_t chunks = (n + grain - 1) / grain;
+
+    auto run_chunk = [&](size_t c)
+    {
+        Index first = begin + (Index)(c * grain);
+        Index last = begin + (Index)std::min(n, (c + 1) * grain);
+        for(Index i = first; i < last; ++i)
+        {
+            fn(i);
+        }
+    };
+    detail::forkJoin(chunks, run_chunk, scheduler);
+}
+
+// 并行归约：每个分块计算fn(first, last, identity)，分块的结果再按下标顺序用combine合并，
+// combine需要满足结合律(不要求交换律)，identity是combine的单位元
+template <class T, class Index, class RangeFn, class Combine>
+T parallel_reduce(Index begin, Index end, T identity, RangeFn fn, Combine combine,
+                  size_t grain = 0, Scheduler* scheduler = Scheduler::getThis())
+{
+    if(!(begin < end))
+    {
+        return identity;
+    }
+    size_t n = (size_t)(end - begin);
+    grain = detail::parallelGrain(n, grain, scheduler);
+    size_t chunks = (n + grain - 1) / grain;
+
+    std::vector<T> results(chunks, identity);
+    auto run_chunk = [&](size_t c)
+    {
+        Index first = begin + (Index)(c * grain);
+        Index last = begin + (Index)std::min(n, (c + 1) * grain);
+        results[c] = fn(first, last, identity);
+    };
+    detail::forkJoin(chunks, run_chunk, scheduler);
+
+    T result = identity;
+    for(auto& r : results)
+    {
+        result = combine(std::move(result), std::move(r));
+    }
+    return result;
+}
+
+// 并行执行几个函数，全部完成后返回
+template <class... Fns>
+void parallel_invoke(Fns&&... fns)
+{
+    std::function<void()> tasks[] = {std::function<void()>(std::forward<Fns>(fns))...};
+    auto run_chunk = [&](size_t c)
+    {
+        tasks[c]();
+    };
+    detail::forkJoin(sizeof...(Fns), run_chunk, Scheduler::getThis());
+}
+
+// 并行排序(不稳定)：切成若干段并行排序，再逐轮两两并行归并
+template <class RandomIt, class Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void parallel_sort(RandomIt begin, RandomIt end, Compare comp = Compare(), Scheduler* scheduler = Scheduler::getThis())
+{
+    //小于这个长度时直接排序，并行的调度开销超过收益
+    static const size_t SERIAL_CUTOFF = 4096;
+
+    size_t n = (size_t)(end - begin);
+    size_t workers = detail::parallelWorkers(scheduler);
+    if(n <= SERIAL_CUTOFF || workers == 1)
+    {
+        std::sort(begin, end, comp);
+        return;
+    }
+
+    //段数取不超过线程数两倍的2的幂，归并轮数为log2(段数)
+    size_t segments = 1;
+    while(segments < workers * 2 && n / (segments * 2) >= SERIAL_CUTOFF / 2)
+    {
+        segments *= 2;
+    }
+    size_t seg_len = (n + segments - 1) / segments;
+    auto bound = [&](size_t s)
+    {
+        return begin + (std::ptrdiff_t)std::min(n, s * seg_len);
+    };
+
+    parallel_for((size_t)0, segments, [&](size_t s)
+    {
+        std::sort(bound(s), bound(s + 1), comp);
+    }, 1, scheduler);
+
+    for(size_t width = 1; width < segments; width *= 2)
+    {
+        parallel_for((size_t)0, segments / (width * 2), [&](size_t pair)
+        {
+            size_t first = pair * width * 2;
+            std::inplace_merge(bound(first), bound(first + width), bound(first + width * 2), comp);
+        }, 1, scheduler);
+    }
+}
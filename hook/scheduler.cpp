@@ -1,10 +1,30 @@
 #include "scheduler.h"
 
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
 
 static bool debug = false;
 
 static thread_local Scheduler* t_scheduler = nullptr;
 
+thread_local Scheduler::WorkerSlot* Scheduler::t_worker = nullptr;
+
+//连续从run next槽位取任务的上限，之后先取一次队列中的任务，防止两个互相唤醒的协程饿死其他任务
+static const int MAX_RUN_NEXT_STREAK = 3;
+
+//每次从无锁投递队列转入任务队列的最大任务数，避免持有m_mutex太久
+static const int MAX_INTAKE_BATCH = 64;
+
+//其他线程的run next槽位中的任务等待超过这个时间(那个线程一直在执行当前任务)后，空闲线程可以取走
+static const uint64_t RUN_NEXT_STEAL_US = 100;
+
+//当前工作线程最后一次执行完任务的时间，弹性线程池据此回收空闲线程
+static thread_local uint64_t t_idle_since_us = 0;
+
+//当前工作线程已经决定退出
+static thread_local bool t_retiring = false;
+
 
 
 /*
@@ -29,7 +49,7 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name) :
         threads--;
 
         //创建主协程
-        Fiber::getThis();
+        Fiber::getThisPtr();
 
         //创建调度协程
         m_scheduler_fiber.reset(new Fiber(std::bind(&Scheduler::run, this), 0, false)); // false -> 该调度协程退出后将返回主协程
@@ -40,6 +60,8 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name) :
     }
 
     m_thread_count = threads;
+    m_intake_head = new IntakeNode();
+    m_intake_tail = m_intake_head;
     if(debug) std::cout << "Scheduler::Scheduler() success" << std::endl;
 
 }
@@ -60,13 +82,550 @@ void Scheduler::start()
         m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i)));
         m_thread_ids.push_back(m_threads[i]->getId());
     }
+    m_thread_seq = m_thread_count;
     if(debug) std::cout << "Scheduler::start() success" << std::endl;
 }
 
 bool Scheduler::stopping()
 {
     std::lock_guard<std::mutex> lock(m_mutex);
-    return m_stopping && m_tasks.empty() && m_activate_thread_count == 0;
+    return m_stopping && m_task_count == 0 && m_run_next_count == 0 && m_intake_count == 0
+        && m_activate_thread_count == 0 && m_blocking_count == 0;
+}
+
+void Scheduler::pushIntake(IntakeNode* node)
+{
+    IntakeNode* prev = m_intake_tail.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+
+    //之前不为空时，已经有人唤醒过工作线程
+    if(m_intake_count.fetch_add(1, std::memory_order_acq_rel) == 0)
+    {
+        tickle();
+    }
+}
+
+bool Scheduler::drainIntake()
+{
+    if(m_intake_count.load(std::memory_order_acquire) == 0)
+    {
+        return false;
+    }
+
+    for(int i = 0; i < MAX_INTAKE_BATCH; ++i)
+    {
+        IntakeNode* head = m_intake_head;
+        IntakeNode* next = head->next.load(std::memory_order_acquire);
+        if(!next)
+        {
+            //队列为空，或者生产者已经交换了尾指针但还没有链接上节点
+            break;
+        }
+
+        //next成为新的哨兵节点
+        m_intake_head = next;
+        delete head;
+        m_tasks[next->task.priority].push_back(std::move(next->task));
+        next->task.reset();
+        ++m_task_count;
+        m_intake_count.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    return m_intake_count.load(std::memory_order_acquire) > 0;
+}
+
+void Scheduler::futexWait(std::atomic<int>* word, int expected)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void Scheduler::futexWake(std::atomic<int>* word)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+void Scheduler::pushRunNext(ScheduleTask& task)
+{
+    //只接收工作线程正在执行的任务协程唤醒的其他任务；
+    //调度协程重新排队的任务(例如被抢占的协程)和协程把自己重新排队(主动让出)都放入队列。
+    //空闲协程处理一批IO事件和定时器时没有在执行任务，唤醒的任务也放入队列交给空闲线程并行执行：
+    //放入槽位的话它们只能等当前线程处理完整批事件，或者等其他线程偷取
+    WorkerSlot* worker = t_worker;
+    if(!worker || worker->scheduler != this || task.thread != -1
+       || worker->start_us.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+    Fiber* curr = Fiber::getThisPtr();
+    if(!curr->isRunInScheduler() || task.fiber.get() == curr)
+    {
+        return;
+    }
+
+    std::swap(task, worker->run_next);
+    if(!task.valid())
+    {
+        ++m_run_next_count;
+    }
+}
+
+void Scheduler::acquireTask(const ScheduleTask& task, uint64_t now)
+{
+    m_activate_thread_count++;
+
+    //排队延迟统计
+    QueueStats& stats = m_stats[task.priority];
+    uint64_t delay = now > task.enqueue_us ? now - task.enqueue_us : 0;
+    ++stats.tasks;
+    stats.total_delay_us += delay;
+    stats.max_delay_us = std::max(stats.max_delay_us, delay);
+}
+
+bool Scheduler::takeTask(WorkerSlot& worker, ScheduleTask& task)
+{
+    int thread_id = worker.thread_id;
+    bool tickle_me = false; //是否有指定给其他线程的任务
+    size_t reserved = 0;    //跳过的还在亲和窗口内的任务数，不为它们唤醒其他线程
+
+    //普通线程投递的任务先转入任务队列，还有剩余时唤醒其他线程继续转入
+    tickle_me = drainIntake();
+    worker.retry_us = 0;
+    //转入之后再取时间：刚转入的任务入队时间可能晚于转入之前取的时间。
+    //下面的比较也不做减法，入队时间比now晚时不会回绕成很大的等待时间
+    uint64_t now = nowUs();
+
+    // 0、先取run next槽位：刚被当前线程唤醒的任务，它需要的数据还在缓存中。
+    //    有更高优先级的任务排队，或者已经连续取了多次槽位时，先看队列
+    if(worker.run_next.valid() && worker.run_next_streak < MAX_RUN_NEXT_STREAK)
+    {
+        bool higher = false;
+        for(int p = PRIORITY_HIGH; p < worker.run_next.priority; ++p)
+        {
+            higher = higher || !m_tasks[p].empty();
+        }
+        if(!higher)
+        {
+            task = std::move(worker.run_next);
+            worker.run_next.reset();
+            --m_run_next_count;
+            ++worker.run_next_streak;
+            acquireTask(task, now);
+            return m_task_count > 0;
+        }
+    }
+
+    // 1、遍历任务队列：先看低优先级队列中最早的任务是否等待超过了上限，防止被饿死；
+    //    否则按优先级从高到低，取第一个当前线程可以执行的任务
+    std::deque<ScheduleTask>* queue = nullptr;
+    std::deque<ScheduleTask>::iterator found;
+    for(int p = PRIORITY_COUNT - 1; p > PRIORITY_HIGH && !queue; --p)
+    {
+        for(auto it = m_tasks[p].begin(); it != m_tasks[p].end(); ++it)
+        {
+            // 检查任务是否指定了特定线程执行
+            if(it->thread != -1 && it->thread != thread_id)
+            {
+                continue;
+            }
+            if(now >= it->enqueue_us + m_starvation_us)
+            {
+                queue = &m_tasks[p];
+                found = it;
+            }
+            break;
+        }
+    }
+    for(int p = PRIORITY_HIGH; p < PRIORITY_COUNT && !queue; ++p)
+    {
+        for(auto it = m_tasks[p].begin(); it != m_tasks[p].end(); ++it)
+        {
+            if(it->thread != -1 && it->thread != thread_id)
+            {
+                tickle_me = true;
+                continue;
+            }
+            // 亲和时间窗口内留给上次运行它的线程。不唤醒其他线程：空闲的线程之间会互相唤醒直到窗口结束，
+            // 当前线程空闲时最多等到窗口结束，原来的线程一直没有取走就由当前线程执行
+            if(it->hint != -1 && it->hint != thread_id && now < it->enqueue_us + m_sticky_us)
+            {
+                uint64_t expire = it->enqueue_us + m_sticky_us;
+                if(worker.retry_us == 0 || expire < worker.retry_us)
+                {
+                    worker.retry_us = expire;
+                }
+                ++reserved;
+                continue;
+            }
+            queue = &m_tasks[p];
+            found = it;
+            break;
+        }
+    }
+
+    if(queue)
+    {
+        // 2、取出任务
+        /*
+            完整引用计数变化流程
+                1.取出任务前：
+                引用计数=1（只由队列持有）
+
+                2.取出任务后：
+                引用计数=1（由局部变量 task 持有）
+
+                3.执行 resume() 进入协程：
+                t_fiber 被设置为当前协程的原始指针
+                尚未创建新的 shared_ptr，引用计数=1
+                
+                4.mainFunc() 通过 getThisPtr() 取得裸指针：
+                不增加引用计数，引用计数=1，只由局部变量 task 持有
+                
+                5.执行完毕：
+                执行 yield() 返回调度器
+                
+                6.调度器继续执行：
+                task.reset() 释放最后一份引用，引用计数=0
+                协程对象被销毁
+        */
+        assert(found->valid());
+        task = std::move(*found);
+        queue->erase(found);
+        --m_task_count;
+        worker.run_next_streak = 0;
+        acquireTask(task, now);
+    }
+    else if(worker.run_next.valid())
+    {
+        //队列中没有可执行的任务，不受连续次数限制
+        task = std::move(worker.run_next);
+        worker.run_next.reset();
+        --m_run_next_count;
+        worker.run_next_streak = 0;
+        acquireTask(task, now);
+    }
+    else if(m_run_next_count > 0)
+    {
+        // 3、从一直在执行当前任务的其他线程的槽位中取走任务
+        std::lock_guard<std::mutex> lock(m_worker_mutex);
+        for(WorkerSlot* other : m_workers)
+        {
+            if(other == &worker || !other->run_next.valid())
+            {
+                continue;
+            }
+            //那个线程已经执行完当前任务，马上会自己取走槽位
+            uint64_t start = other->start_us.load();
+            if(start == 0)
+            {
+                continue;
+            }
+            //当前任务还没有执行太久，空闲时等到可以偷取的时间再检查，不唤醒其他线程
+            if(now < start + RUN_NEXT_STEAL_US)
+            {
+                if(worker.retry_us == 0 || start + RUN_NEXT_STEAL_US < worker.retry_us)
+                {
+                    worker.retry_us = start + RUN_NEXT_STEAL_US;
+                }
+                continue;
+            }
+            task = std::move(other->run_next);
+            other->run_next.reset();
+            --m_run_next_count;
+            acquireTask(task, now);
+            break;
+        }
+    }
+
+    return tickle_me || m_task_count > reserved;  //确保仍然存在未处理的任务
+}
+
+void Scheduler::setPreemption(uint64_t slice_ms, PreemptReporter reporter)
+{
+    assert(slice_ms > 0);
+    std::lock_guard<std::mutex> lock(m_monitor_mutex);
+    assert(m_slice_us == 0);
+    m_slice_us = slice_ms * 1000;
+    m_preempt_reporter = reporter;
+    startMonitor();
+}
+
+void Scheduler::setElastic(size_t min_threads, size_t max_threads, uint64_t grow_latency_ms,
+                           size_t grow_blocked, uint64_t idle_ms)
+{
+    assert(min_threads <= max_threads && max_threads > 0 && grow_latency_ms > 0);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_min_threads = min_threads;
+        m_max_threads = max_threads;
+        m_grow_latency_us = grow_latency_ms * 1000;
+        m_grow_blocked = std::max<size_t>(grow_blocked, 1);
+        m_idle_retire_us = idle_ms * 1000;
+        m_elastic = true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_monitor_mutex);
+    startMonitor();
+    m_monitor_cv.notify_one();  //按新的参数重新计算检查间隔
+}
+
+size_t Scheduler::getThreadCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_thread_count;
+}
+
+void Scheduler::startMonitor()
+{
+    //IOManager的构造函数已经调用了start()，监控线程在第一次需要时创建
+    if(!m_monitor)
+    {
+        m_monitor.reset(new Thread(std::bind(&Scheduler::monitor, this), m_name + "_monitor"));
+    }
+}
+
+void Scheduler::monitor()
+{
+    std::unique_lock<std::mutex> lock(m_monitor_mutex);
+    while(!m_monitor_stop)
+    {
+        //抢占检查间隔取时间片的一半，超时最多晚半个时间片被发现；扩容检查间隔取排队延迟阈值的一半
+        uint64_t interval_us = 100 * 1000;
+        if(m_slice_us)
+        {
+            interval_us = std::min(interval_us, m_slice_us / 2);
+        }
+        if(m_elastic)
+        {
+            std::lock_guard<std::mutex> elastic_lock(m_mutex);
+            interval_us = std::min(interval_us, m_grow_latency_us / 2);
+        }
+        m_monitor_cv.wait_for(lock, std::chrono::microseconds(std::max<uint64_t>(interval_us, 1000)));
+        if(m_monitor_stop)
+        {
+            break;
+        }
+
+        uint64_t now = nowUs();
+        std::vector<PreemptReport> reports;
+        if(m_slice_us)
+        {
+            checkPreemption(now, reports);
+        }
+        if(m_elastic)
+        {
+            checkElastic(now);
+        }
+
+        //报告时不持有锁
+        lock.unlock();
+        for(auto& r : reports)
+        {
+            if(m_preempt_reporter)
+            {
+                m_preempt_reporter(r.thread_id, r.fiber_id, r.run_ms);
+            }
+            else
+            {
+                std::cerr << "Scheduler(" << m_name << ") fiber " << r.fiber_id << " on thread " << r.thread_id
+                          << " has been running for " << r.run_ms << "ms without yielding" << std::endl;
+            }
+        }
+        lock.lock();
+    }
+}
+
+void Scheduler::checkPreemption(uint64_t now, std::vector<PreemptReport>& reports)
+{
+    std::lock_guard<std::mutex> lock(m_worker_mutex);
+    for(WorkerSlot* slot : m_workers)
+    {
+        uint64_t start = slot->start_us.load();
+        if(start == 0 || now < start + m_slice_us)
+        {
+            continue;
+        }
+
+        slot->preempt = true;
+        if(slot->reported_us != start)
+        {
+            slot->reported_us = start;
+            ++m_preempt_count;
+            reports.push_back(PreemptReport{slot->thread_id, slot->fiber_id.load(), (now - start) / 1000});
+        }
+    }
+}
+
+void Scheduler::checkElastic(uint64_t now)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_stopping || m_thread_count >= m_max_threads)
+    {
+        return;
+    }
+    if(m_thread_count < m_min_threads)
+    {
+        addThread();
+        return;
+    }
+    if(m_task_count == 0 || m_idle_thread_count > 0)
+    {
+        return;
+    }
+
+    //队首任务最早入队，它的等待时间就是当前的排队延迟
+    uint64_t oldest = now;
+    for(int p = PRIORITY_HIGH; p < PRIORITY_COUNT; ++p)
+    {
+        if(!m_tasks[p].empty())
+        {
+            oldest = std::min(oldest, m_tasks[p].front().enqueue_us);
+        }
+    }
+
+    //长时间没有回到调度器的线程，通常阻塞在没有hook的系统调用里
+    size_t blocked = 0;
+    {
+        std::lock_guard<std::mutex> workers_lock(m_worker_mutex);
+        for(WorkerSlot* slot : m_workers)
+        {
+            uint64_t start = slot->start_us.load();
+            if(start != 0 && now >= start + m_grow_latency_us)
+            {
+                ++blocked;
+            }
+        }
+    }
+
+    if(now - oldest >= m_grow_latency_us || blocked >= m_grow_blocked)
+    {
+        if(debug) std::cout << "Scheduler::checkElastic() grow, delay_us = " << now - oldest << " blocked = " << blocked << std::endl;
+        addThread();
+    }
+}
+
+void Scheduler::addThread()
+{
+    std::shared_ptr<Thread> thread(new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(m_thread_seq++)));
+    bindThread(thread.get());
+    m_threads.push_back(thread);
+    m_thread_ids.push_back(thread->getId());
+    ++m_thread_count;
+}
+
+void Scheduler::setAffinity(AffinityPolicy policy)
+{
+    std::vector<std::vector<int>> nodes = Thread::getNumaNodes();
+    std::vector<std::vector<int>> cpu_sets;
+    if(policy == AFFINITY_CORE)
+    {
+        for(auto& node : nodes)
+        {
+            for(int cpu : node)
+            {
+                cpu_sets.push_back(std::vector<int>(1, cpu));
+            }
+        }
+    }
+    else if(policy == AFFINITY_NODE)
+    {
+        cpu_sets = nodes;
+    }
+    setAffinity(cpu_sets);
+}
+
+void Scheduler::setAffinity(const std::vector<std::vector<int>>& cpu_sets)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cpu_sets = cpu_sets;
+    m_next_cpu_set = 0;
+    if(m_cpu_sets.empty())
+    {
+        //取消绑定：允许在所有CPU上运行
+        std::vector<int> all;
+        for(auto& node : Thread::getNumaNodes())
+        {
+            all.insert(all.end(), node.begin(), node.end());
+        }
+        if(m_root_thread != -1 && m_root_thread == Thread::getThreadId())
+        {
+            Thread::setCurrentAffinity(all);
+        }
+        for(auto& thread : m_threads)
+        {
+            thread->setAffinity(all);
+        }
+        return;
+    }
+
+    if(m_root_thread != -1 && m_root_thread == Thread::getThreadId())
+    {
+        int rt = Thread::setCurrentAffinity(m_cpu_sets[m_next_cpu_set++ % m_cpu_sets.size()]);
+        if(rt)
+        {
+            std::cerr << "Scheduler::setAffinity() bind caller thread fail, rt=" << rt << std::endl;
+        }
+    }
+    for(auto& thread : m_threads)
+    {
+        bindThread(thread.get());
+    }
+}
+
+void Scheduler::bindThread(Thread* thread)
+{
+    if(m_cpu_sets.empty())
+    {
+        return;
+    }
+    int rt = thread->setAffinity(m_cpu_sets[m_next_cpu_set++ % m_cpu_sets.size()]);
+    if(rt)
+    {
+        std::cerr << "Scheduler::bindThread() fail, rt=" << rt << " name=" << thread->getName() << std::endl;
+    }
+}
+
+uint64_t Scheduler::getRetryTimeout()
+{
+    WorkerSlot* worker = t_worker;
+    if(!worker || worker->scheduler != this || worker->retry_us == 0)
+    {
+        return ~0ull;
+    }
+    uint64_t now = nowUs();
+    if(worker->retry_us <= now)
+    {
+        return 0;
+    }
+    return (worker->retry_us - now + 999) / 1000;
+}
+
+bool Scheduler::shouldRetire()
+{
+    if(!m_elastic || Thread::getThreadId() == m_root_thread)
+    {
+        return false;
+    }
+    if(nowUs() - t_idle_since_us < m_idle_retire_us)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_stopping || m_task_count > 0 || m_thread_count <= m_min_threads)
+    {
+        return false;
+    }
+    //先减少线程数，多个线程同时空闲时不会退出到min_threads以下
+    --m_thread_count;
+    t_retiring = true;
+    return true;
+}
+
+Scheduler::QueueStats Scheduler::getQueueStats(Priority priority)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    QueueStats stats = m_stats[priority];
+    stats.queued = m_tasks[priority].size();
+    return stats;
 }
 
 //作用：调度器的核心，负责从任务队列中取出任务并通过协程执行
@@ -80,11 +639,24 @@ void Scheduler::run()
     //不是主线程的话，需要创建主协程和调度协程，主线程的主协程在Scheduler构造函数中创建
     if(thread_id != m_root_thread)
     {
-        Fiber::getThis();
+        Fiber::getThisPtr();
     }
 
+    //登记工作线程，供抢占看门狗检查
+    WorkerSlot slot;
+    slot.scheduler = this;
+    slot.thread_id = thread_id;
+    {
+        std::lock_guard<std::mutex> lock(m_worker_mutex);
+        m_workers.push_back(&slot);
+    }
+    Fiber::setPreemptFlag(&slot.preempt);
+    t_worker = &slot;
+    t_idle_since_us = nowUs();
+    t_retiring = false;
+
     //空闲协程
-    std::shared_ptr<Fiber> idle_fiber = std::make_shared<Fiber>(std::bind(&Scheduler::idle, this));
+    FiberPtr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
     ScheduleTask task;
 
     while(true)
@@ -94,51 +666,7 @@ void Scheduler::run()
 
         {
             std::lock_guard<std::mutex> lock(m_mutex);
-            auto it = m_tasks.begin();
-
-            // 1、遍历任务队列
-            while(it != m_tasks.end())
-            {
-                // 检查任务是否指定了特定线程执行
-                if(it->thread != -1 && it->thread != thread_id) 
-                {
-                    it++;
-                    tickle_me = true;
-                    continue;
-                }
-
-                // 2、取出任务
-                /*
-                    完整引用计数变化流程
-                        1.取出任务前：
-                        引用计数=1（只由队列持有）
-
-                        2.取出任务后：
-                        引用计数=1（由局部变量 task 持有）
-
-                        3.执行 resume() 进入协程：
-                        t_fiber 被设置为当前协程的原始指针
-                        尚未创建新的 shared_ptr，引用计数=1
-                        
-                        4.在 mainFunc() 中调用 getThis()：
-                        通过 shared_from_this() 创建新引用，引用计数=2
-                        局部变量 task 和 curr 各持有一份
-                        
-                        5.执行完毕：
-                        curr.reset() 释放一份引用，引用计数=1
-                        执行 yield() 返回调度器
-                        
-                        6.调度器继续执行：
-                        task.reset() 释放最后一份引用，引用计数=0
-                        协程对象被销毁
-                */
-                assert(it->fiber || it->cb);
-                task = *it;
-                m_tasks.erase(it);
-                m_activate_thread_count++;
-                break;
-            }
-            tickle_me = tickle_me || (it != m_tasks.end()); //确保仍然存在未处理的任务
+            tickle_me = takeTask(slot, task);
         }
 
         if(tickle_me)
@@ -150,6 +678,9 @@ void Scheduler::run()
         if(task.fiber)
         {
             //resume协程，resume返回时此时任务要么执行完了，要么半路yield了，总之任务完成了，活跃线程-1；
+            slot.fiber_id = task.fiber->getId();
+            slot.start_us = nowUs();
+            task.fiber->setLastThread(thread_id);
             {
                 std::lock_guard<std::mutex> lock(task.fiber->m_mutex);
                 if(task.fiber->getState() != Fiber::TREM)
@@ -157,20 +688,65 @@ void Scheduler::run()
                     task.fiber->resume();
                 }
             }
+            slot.start_us = 0;
+            slot.preempt = false;
+            //在maybeYield()处被抢占的协程重新排到队尾
+            if(task.fiber->takePreempted())
+            {
+                scheduleLock(task.fiber);
+            }
             m_activate_thread_count--;
+            t_idle_since_us = nowUs();
+            task.reset();
+        }
+        else if(task.cb && task.run_inline)
+        {
+            //不会阻塞的回调直接在调度协程的栈上执行，不需要创建协程和切换上下文
+            slot.fiber_id = 0;
+            slot.start_us = nowUs();
+            task.cb();
+            slot.start_us = 0;
+            slot.preempt = false;
+            m_activate_thread_count--;
+            t_idle_since_us = nowUs();
             task.reset();
         }
         else if(task.cb)
         {
             //对于函数也应该被调度，具体做法就封装成协程加入调度。
-            std::shared_ptr<Fiber> cb_fiber = std::make_shared<Fiber>(task.cb);
+            FiberPtr cb_fiber(new Fiber(std::move(task.cb)));
+            cb_fiber->setPriority(task.priority);   //协程之后挂起再被调度时沿用任务的优先级
+            cb_fiber->setLastThread(thread_id);
+            slot.fiber_id = cb_fiber->getId();
+            slot.start_us = nowUs();
             {
                 std::lock_guard<std::mutex> lock(cb_fiber->m_mutex);
                 cb_fiber->resume();
             }
+            slot.start_us = 0;
+            slot.preempt = false;
+            if(cb_fiber->takePreempted())
+            {
+                scheduleLock(cb_fiber);
+            }
             m_activate_thread_count--;
+            t_idle_since_us = nowUs();
             task.reset();
         }
+#ifdef __cpp_impl_coroutine
+        else if(task.handle)
+        {
+            //无栈协程在调度协程的栈上运行，直到下一个挂起点返回。无法被抢占，但超时仍会被看门狗报告
+            slot.fiber_id = 0;
+            slot.start_us = nowUs();
+            task.handle.resume();
+            slot.start_us = 0;
+            slot.preempt = false;
+            m_activate_thread_count--;
+            t_idle_since_us = nowUs();
+            task.reset();
+        }
+#endif
         // 4、没有任务则执行空闲函数
         else
         {
@@ -187,15 +763,55 @@ void Scheduler::run()
             m_idle_thread_count--;
         }
     }
+
+    Fiber::setPreemptFlag(nullptr);
+    t_worker = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_worker_mutex);
+        for(auto it = m_workers.begin(); it != m_workers.end(); ++it)
+        {
+            if(*it == &slot)
+            {
+                m_workers.erase(it);
+                break;
+            }
+        }
+    }
+
+    //弹性线程池回收的线程：Thread的析构函数会detach当前线程，此后不能再访问调度器
+    if(t_retiring)
+    {
+        if(debug) std::cout << "Scheduler::run() retires thread: " << thread_id << std::endl;
+        idle_fiber.reset();
+        std::shared_ptr<Thread> self;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(size_t i = 0; i < m_threads.size(); ++i)
+        {
+            if(m_threads[i]->getId() == thread_id)
+            {
+                self = m_threads[i];
+                m_threads.erase(m_threads.begin() + i);
+                break;
+            }
+        }
+        for(auto it = m_thread_ids.begin(); it != m_thread_ids.end(); ++it)
+        {
+            if(*it == thread_id)
+            {
+                m_thread_ids.erase(it);
+                break;
+            }
+        }
+    }
 }
 
 void Scheduler::idle()
 {
-    while(!stopping())
+    while(!stopping() && !shouldRetire())
     {
         if(debug) std::cout << "Scheduler::idle() thread_id = " << Thread::getThreadId() << std::endl;
         sleep(1);   //降低空闲协程在无任务时对cpu占用率，避免空转浪费资源
-        Fiber::getThis()->yield();
+        Fiber::getThisPtr()->yield();
     }
 }
 
@@ -208,7 +824,10 @@ void Scheduler::stop()
         return;
     }
 
-    m_stopping = true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
 
     if(m_use_caller)
     {
@@ -246,6 +865,17 @@ void Scheduler::stop()
         i->join();
     }
 
+    if(m_monitor)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_monitor_mutex);
+            m_monitor_stop = true;
+        }
+        m_monitor_cv.notify_one();
+        m_monitor->join();
+        m_monitor.reset();
+    }
+
     if(debug) std::cout << "Scheduler::stop() ends in thread: " << Thread::getThreadId() << std::endl; 
 
 }
@@ -253,6 +883,12 @@ void Scheduler::stop()
 Scheduler::~Scheduler()
 {
     assert(stopping() == true);
+    while(m_intake_head)
+    {
+        IntakeNode* next = m_intake_head->next.load(std::memory_order_relaxed);
+        delete m_intake_head;
+        m_intake_head = next;
+    }
     if(getThis() == this)
     {
         t_scheduler = nullptr;
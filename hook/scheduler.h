@@ -2,8 +2,21 @@
 
 #include "fiber.h"
 #include "thread.h"
+#include "blockingpool.h"
 
 #include <vector>
+#include <deque>
+#include <chrono>
+#include <condition_variable>
+#include <optional>
+#include <exception>
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
+
+template <class T>
+class Future;
 
 class Scheduler
 {
@@ -23,28 +36,186 @@ protected:
     void setThis();
 
 public:
-    //添加任务到任务队列
+    //任务优先级，数值越小越先执行
+    enum Priority
+    {
+        PRIORITY_HIGH = 0,      //健康检查、控制面、延迟敏感的请求
+        PRIORITY_NORMAL = 1,
+        PRIORITY_LOW = 2,       //批处理等后台任务
+        PRIORITY_COUNT = 3
+    };
+
+    //每个优先级的排队延迟统计
+    struct QueueStats
+    {
+        uint64_t tasks = 0;             //已经出队执行的任务数
+        uint64_t total_delay_us = 0;    //累计排队时间
+        uint64_t max_delay_us = 0;      //最长排队时间
+        size_t queued = 0;              //当前排队的任务数
+    };
+
+    //添加任务到任务队列。priority为-1时协程沿用它自己的优先级，函数使用PRIORITY_NORMAL
     template <class FiberOrCb>
-    void scheduleLock(FiberOrCb fc, int thread = -1)
+    void scheduleLock(FiberOrCb fc, int thread = -1, int priority = -1)
     {
-        bool need_tickle;
+        ScheduleTask task(std::move(fc), thread);
+        enqueue(task, priority);
+    }
+
+    //添加短小、不会阻塞也不会让出的回调(例如只是唤醒其他协程)：直接在调度协程的栈上执行，不创建Fiber。
+    //回调中不能调用hook的阻塞IO、sleep、FiberMutex等会挂起当前协程的接口
+    void scheduleInline(TaskFn cb, int thread = -1, int priority = -1)
+    {
+        ScheduleTask task(std::move(cb), thread);
+        task.run_inline = true;
+        enqueue(task, priority);
+    }
+
+    //在调度器中新建协程执行fn，通过返回的Future获取结果或异常。定义在future.h中
+    template <class Fn>
+    auto spawn(Fn fn) -> Future<decltype(fn())>;
+
+    //把可能长时间阻塞的函数(普通文件IO、fsync、CPU密集计算等)交给阻塞线程池执行，
+    //当前协程挂起直到执行完毕后被重新调度，返回fn的结果(异常也会被重新抛出)。
+    //如果当前不在调度器调度的协程中(例如主协程)，无法挂起，直接在当前线程执行。
+    template <class Fn>
+    auto runBlocking(Fn fn) -> decltype(fn())
+    {
+        typedef decltype(fn()) Result;
+
+        FiberPtr fiber = Fiber::getThis();
+        if(!fiber->isRunInScheduler())
         {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            need_tickle = m_tasks.empty();
+            return fn();
+        }
 
-            ScheduleTask task(fc, thread);
-            if(task.fiber || task.cb)
+        BlockingResult<Result> result;
+        std::exception_ptr eptr;
+        Scheduler* scheduler = this;
+        ++m_blocking_count;     //挂起在线程池中的协程也算未完成的任务，调度器不能在此期间停止
+        BlockingPool::getInstance().submit([&result, &eptr, &fn, fiber, scheduler]()
+        {
+            try
+            {
+                result.run(fn);
+            }
+            catch(...)
             {
-                m_tasks.push_back(task);
+                eptr = std::current_exception();
             }
+            //这一步之后协程可能立即在其他线程恢复并销毁栈上的result，不能再访问它们
+            scheduler->scheduleLock(fiber, -1);
+            --scheduler->m_blocking_count;
+        });
+        fiber->yield();
+
+        if(eptr)
+        {
+            std::rethrow_exception(eptr);
         }
+        return result.get();
+    }
 
-        if(need_tickle)
+    //供调度器之外的普通线程投递任务：放入无锁的多生产者队列，不和工作线程竞争m_mutex，
+    //由工作线程取任务时成批转入任务队列。priority的含义同scheduleLock
+    template <class FiberOrCb>
+    void submit(FiberOrCb fc, int priority = -1)
+    {
+        IntakeNode* node = new IntakeNode();
+        node->task = ScheduleTask(std::move(fc), -1);
+        if(!node->task.valid())
         {
-            tickle();
+            delete node;
+            return;
         }
+        prepareTask(node->task, priority);
+        pushIntake(node);
     }
 
+    //普通线程通过submit投递fn，在futex上阻塞当前线程直到fn在协程中执行完毕，返回fn的结果(异常也会被重新抛出)。
+    //用于线程模型的旧代码调用协程代码，不能在调度器的协程中调用(会阻塞工作线程)，协程中应当使用spawn()
+    template <class Fn>
+    auto submitAndWait(Fn fn) -> decltype(fn())
+    {
+        typedef decltype(fn()) Result;
+
+        //执行完的协程还要唤醒等待者，状态由双方共同持有
+        struct State
+        {
+            BlockingResult<Result> result;
+            std::exception_ptr eptr;
+            std::atomic<int> done = {0};
+        };
+        std::shared_ptr<State> state = std::make_shared<State>();
+        submit(TaskFn([state, fn = std::move(fn)]() mutable
+        {
+            try
+            {
+                state->result.run(fn);
+            }
+            catch(...)
+            {
+                state->eptr = std::current_exception();
+            }
+            state->done.store(1, std::memory_order_release);
+            futexWake(&state->done);
+        }));
+
+        while(state->done.load(std::memory_order_acquire) == 0)
+        {
+            futexWait(&state->done, 0);
+        }
+        if(state->eptr)
+        {
+            std::rethrow_exception(state->eptr);
+        }
+        return state->result.get();
+    }
+
+    //低优先级任务排队超过limit_ms后提前执行，防止被高优先级任务饿死
+    void setStarvationLimit(uint64_t limit_ms) { m_starvation_us = limit_ms * 1000;}
+
+    QueueStats getQueueStats(Priority priority);
+
+    //软亲和：被唤醒的协程在window_us内只由它上次运行的线程取出，保持栈和工作集在该线程的缓存中；
+    //那个线程一直忙于其他任务(过载)时，超过window_us后其他线程可以取走。0表示关闭(默认)
+    void setStickyWindow(uint64_t window_us) { m_sticky_us = window_us;}
+
+    //抢占看门狗的报告回调：线程id、协程id、已经连续运行的毫秒数
+    typedef std::function<void(int thread_id, uint64_t fiber_id, uint64_t run_ms)> PreemptReporter;
+
+    //启用抢占看门狗：协程连续运行超过slice_ms时设置抢占标志，协程在Fiber::maybeYield()处让出并重新排队，
+    //同时通过reporter报告(默认输出到std::cerr)。只能调用一次，看门狗线程在stop()时退出
+    void setPreemption(uint64_t slice_ms, PreemptReporter reporter = nullptr);
+
+    //看门狗发现的超时运行次数
+    uint64_t getPreemptCount() const { return m_preempt_count;}
+
+    //启用弹性线程池：工作线程数(不含use_caller的主线程)在[min_threads, max_threads]之间自动伸缩。
+    //监控线程发现队首任务排队超过grow_latency_ms，或者有grow_blocked个以上线程执行同一个任务超过grow_latency_ms
+    //(通常是阻塞在没有hook的系统调用里)，并且没有空闲线程时，新建一个工作线程；
+    //工作线程空闲超过idle_ms且线程数多于min_threads时退出。需要在start()之后调用
+    void setElastic(size_t min_threads, size_t max_threads, uint64_t grow_latency_ms = 10,
+                    size_t grow_blocked = 1, uint64_t idle_ms = 30000);
+
+    //当前的工作线程数(不含use_caller的主线程)
+    size_t getThreadCount();
+
+    //工作线程绑核策略
+    enum AffinityPolicy
+    {
+        AFFINITY_NONE = 0,  //不绑定，由内核调度
+        AFFINITY_CORE = 1,  //每个工作线程绑定一个CPU，按NUMA节点依次分配，相邻的工作线程在同一个节点上
+        AFFINITY_NODE = 2   //每个工作线程绑定一个NUMA节点的所有CPU，工作线程轮流分配到各个节点
+    };
+
+    //按策略绑定工作线程，use_caller的主线程需要在主线程中调用才会被绑定，之后弹性扩容的线程也按同样的策略绑定。
+    //协程栈由工作线程自己的malloc arena分配、第一次访问时分配物理页，绑定后自然落在本地NUMA节点上
+    void setAffinity(AffinityPolicy policy);
+
+    //工作线程依次绑定到cpu_sets[i % cpu_sets.size()]中的CPU上
+    void setAffinity(const std::vector<std::vector<int>>& cpu_sets);
+
     //启动线程池
     virtual void start();
 
@@ -65,13 +236,40 @@ protected:
 
     bool hasIdleThreads() { return m_idle_thread_count > 0;}
 
+    //弹性线程池中当前线程是否应该退出，空闲协程在返回true时结束循环
+    bool shouldRetire();
+
+    //当前线程上次取任务时跳过了还在时间窗口内的任务(留给其他线程)，返回距离窗口结束的毫秒数(向上取整)，
+    //没有时返回~0ull。空闲协程最多等待这么久再取一次，不需要其他线程反复唤醒
+    uint64_t getRetryTimeout();
+
 private:
+    static uint64_t nowUs()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //runBlocking在挂起协程栈上保存的执行结果
+    template <class Result>
+    struct BlockingResult
+    {
+        std::optional<Result> value;
+
+        template <class Fn>
+        void run(Fn& fn) { value.emplace(fn()); }
+        Result get() { return std::move(*value); }
+    };
+
     //任务
     struct ScheduleTask
     {
-        std::shared_ptr<Fiber> fiber;
-        std::function<void()> cb;
+        FiberPtr fiber;
+        TaskFn cb;
         int thread; //指定任务需要运行的线程id
+        bool run_inline = false;    //cb不会阻塞，直接在调度协程上执行
+        int hint = -1;  //优先运行的线程id(软亲和)，超过亲和时间窗口后任何线程都可以执行
+        int priority = PRIORITY_NORMAL;
+        uint64_t enqueue_us = 0;    //入队时间，用于统计排队延迟和防饿死
 
         ScheduleTask()
         {
@@ -80,35 +278,65 @@ private:
             thread = -1;
         }
 
-        ScheduleTask(std::shared_ptr<Fiber> f, int thr)
+        ScheduleTask(FiberPtr f, int thr)
         {
             fiber = f;
             thread = thr;
         }
 
-        ScheduleTask(std::shared_ptr<Fiber>* f, int thr)
+        ScheduleTask(FiberPtr* f, int thr)
         {
             fiber.swap(*f);
             thread = thr;
         }
 
-        ScheduleTask(std::function<void()> f, int thr)
+        ScheduleTask(TaskFn f, int thr)
         {
-            cb = f;
+            cb = std::move(f);
             thread = thr;
         }
 
         ScheduleTask(std::function<void()>* f, int thr)
         {
-            cb.swap(*f);
+            cb = TaskFn(std::move(*f));
+            *f = nullptr;
             thread = thr;
         }
 
+#ifdef __cpp_impl_coroutine
+        //C++20协程，直接在调度协程上恢复执行，不需要创建Fiber
+        std::coroutine_handle<> handle;
+
+        ScheduleTask(std::coroutine_handle<> h, int thr)
+        {
+            handle = h;
+            thread = thr;
+        }
+#endif
+
+        bool valid() const
+        {
+#ifdef __cpp_impl_coroutine
+            if(handle)
+            {
+                return true;
+            }
+#endif
+            return fiber || cb;
+        }
+
         void reset()
         {
             fiber = nullptr;
             cb = nullptr;
             thread = -1;
+            run_inline = false;
+            hint = -1;
+            priority = PRIORITY_NORMAL;
+            enqueue_us = 0;
+#ifdef __cpp_impl_coroutine
+            handle = nullptr;
+#endif
         }
 
 
@@ -116,6 +344,119 @@ private:
     };
 
 
+    //工作线程当前执行的任务，供抢占看门狗检查
+    struct WorkerSlot
+    {
+        Scheduler* scheduler = nullptr;
+        int thread_id = -1;
+        std::atomic<uint64_t> fiber_id = {0};
+        std::atomic<uint64_t> start_us = {0};   //开始执行当前任务的时间，0表示没有在执行任务
+        std::atomic<bool> preempt = {false};    //Fiber::maybeYield()检查的抢占标志
+        uint64_t reported_us = 0;               //已经报告过的任务开始时间，同一次运行只报告一次
+
+        //run next槽位：这个线程上的协程最近唤醒的任务，当前任务让出后优先执行。由m_mutex保护
+        ScheduleTask run_next;
+        int run_next_streak = 0;                //连续从槽位取任务的次数
+
+        //上次取任务时跳过的任务最早可以被这个线程取走的时间，0表示没有跳过。只由这个线程访问
+        uint64_t retry_us = 0;
+    };
+
+    //需要报告的超时运行
+    struct PreemptReport
+    {
+        int thread_id;
+        uint64_t fiber_id;
+        uint64_t run_ms;
+    };
+
+private:
+    //无锁投递队列的节点
+    struct IntakeNode
+    {
+        ScheduleTask task;
+        std::atomic<IntakeNode*> next = {nullptr};
+    };
+
+    //把任务放入run next槽位或任务队列，队列从空变为非空时唤醒空闲线程
+    void enqueue(ScheduleTask& task, int priority)
+    {
+        bool need_tickle;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            need_tickle = m_task_count == 0;
+
+            if(task.valid())
+            {
+                prepareTask(task, priority);
+                pushRunNext(task);
+                if(task.valid())
+                {
+                    m_tasks[task.priority].push_back(std::move(task));
+                    ++m_task_count;
+                }
+            }
+        }
+
+        if(need_tickle)
+        {
+            tickle();
+        }
+    }
+
+    //设置任务的优先级、入队时间和亲和线程
+    void prepareTask(ScheduleTask& task, int priority)
+    {
+        if(priority < 0)
+        {
+            priority = task.fiber ? task.fiber->getPriority() : PRIORITY_NORMAL;
+        }
+        task.priority = std::min(std::max(priority, (int)PRIORITY_HIGH), (int)PRIORITY_COUNT - 1);
+        task.enqueue_us = nowUs();
+        if(m_sticky_us && task.fiber && task.thread == -1)
+        {
+            task.hint = task.fiber->getLastThread();
+        }
+    }
+
+    //把节点放入无锁投递队列，队列从空变为非空时唤醒空闲线程
+    void pushIntake(IntakeNode* node);
+
+    //把无锁投递队列中的任务成批转入任务队列，调用时需要持有m_mutex(同一时刻只有一个消费者)。返回是否还有剩余
+    bool drainIntake();
+
+    //阻塞直到*word不等于expected(可能虚假唤醒)
+    static void futexWait(std::atomic<int>* word, int expected);
+    static void futexWake(std::atomic<int>* word);
+
+    //按优先级取出当前线程可以执行的任务，调用时需要持有m_mutex。返回是否需要唤醒其他线程
+    bool takeTask(WorkerSlot& worker, ScheduleTask& task);
+
+    //取出任务后的计数和排队延迟统计，调用时需要持有m_mutex
+    void acquireTask(const ScheduleTask& task, uint64_t now);
+
+    //工作线程的协程唤醒的任务放入当前线程的run next槽位，槽位中原来的任务换出到task中，由调用者放回队列。
+    //调用时需要持有m_mutex
+    void pushRunNext(ScheduleTask& task);
+
+    //启动监控线程，调用时需要持有m_monitor_mutex
+    void startMonitor();
+
+    //监控线程函数：抢占看门狗和弹性线程池的扩容检查
+    void monitor();
+
+    //检查超时运行的协程，返回需要报告的记录
+    void checkPreemption(uint64_t now, std::vector<PreemptReport>& reports);
+
+    //检查是否需要新建工作线程
+    void checkElastic(uint64_t now);
+
+    //新建一个工作线程，调用时需要持有m_mutex
+    void addThread();
+
+    //按绑核设置绑定线程，调用时需要持有m_mutex
+    void bindThread(Thread* thread);
+
 private:
     std::string m_name;
     std::mutex m_mutex;
@@ -123,8 +464,23 @@ private:
     //线程池
     std::vector<std::shared_ptr<Thread>> m_threads;
 
-    //任务队列
-    std::vector<ScheduleTask> m_tasks;
+    //每个优先级一个任务队列
+    std::deque<ScheduleTask> m_tasks[PRIORITY_COUNT];
+    //所有队列中的任务总数
+    size_t m_task_count = 0;
+    //run next槽位中的任务数
+    size_t m_run_next_count = 0;
+
+    //普通线程投递任务的无锁队列：m_intake_head只由持有m_mutex的消费者访问，生产者只交换m_intake_tail
+    IntakeNode* m_intake_head;
+    std::atomic<IntakeNode*> m_intake_tail;
+    std::atomic<size_t> m_intake_count = {0};
+    //防饿死的排队时间上限
+    uint64_t m_starvation_us = 100 * 1000;
+    //排队延迟统计
+    QueueStats m_stats[PRIORITY_COUNT];
+    //软亲和的时间窗口
+    uint64_t m_sticky_us = 0;
 
     //存储工作线程的线程id
     std::vector<int> m_thread_ids;
@@ -138,14 +494,57 @@ private:
     //空闲线程数
     std::atomic<size_t> m_idle_thread_count = {0};
 
+    //挂起等待阻塞线程池的协程数
+    std::atomic<size_t> m_blocking_count = {0};
+
     //主线程是否用作工作线程
     bool m_use_caller;
 
-    std::shared_ptr<Fiber> m_scheduler_fiber;
+    FiberPtr m_scheduler_fiber;
 
     int m_root_thread = -1;
 
     bool m_stopping = false;
 
+    //监控线程
+    std::shared_ptr<Thread> m_monitor;
+    std::mutex m_monitor_mutex;
+    std::condition_variable m_monitor_cv;
+    bool m_monitor_stop = false;
+
+    //抢占看门狗
+    uint64_t m_slice_us = 0;
+    PreemptReporter m_preempt_reporter;
+    std::atomic<uint64_t> m_preempt_count = {0};
 
+    //弹性线程池，参数由m_mutex保护
+    std::atomic<bool> m_elastic = {false};
+    size_t m_min_threads = 0;
+    size_t m_max_threads = 0;
+    uint64_t m_grow_latency_us = 0;
+    size_t m_grow_blocked = 0;
+    uint64_t m_idle_retire_us = 0;
+    //新建线程的名字序号
+    size_t m_thread_seq = 0;
+
+    //工作线程依次绑定的CPU集合，空表示不绑定
+    std::vector<std::vector<int>> m_cpu_sets;
+    size_t m_next_cpu_set = 0;
+
+    //正在运行的工作线程
+    std::mutex m_worker_mutex;
+    std::vector<WorkerSlot*> m_workers;
+
+    //当前线程的工作线程登记
+    static thread_local WorkerSlot* t_worker;
+
+
+};
+
+template <>
+struct Scheduler::BlockingResult<void>
+{
+    template <class Fn>
+    void run(Fn& fn) { fn(); }
+    void get() {}
 };
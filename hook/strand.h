@@ -0,0 +1,169 @@
+#pragma once
+
+#include "scheduler.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <thread>
+
+// 串行执行器：投递到同一个Strand的任务按投递顺序逐个执行(可以在任意工作线程上)，不同Strand的任务并行执行，
+// 同一个对象(会话、分片)的所有操作投递到同一个Strand即可保证顺序，不再需要互斥锁。
+// 投递是无锁的：任务放入多生产者单消费者队列，只有队列从空变为非空的那次投递才向调度器提交一个排空任务，
+// 排空任务在一个协程中依次执行队列中的任务。任务在hook的IO上挂起时后续任务也随之等待，顺序不会被打乱。
+// Strand必须由shared_ptr持有，排空任务持有它的引用。
+class Strand : public std::enable_shared_from_this<Strand>
+{
+public:
+    explicit Strand(Scheduler* scheduler = Scheduler::getThis())
+        : m_scheduler(scheduler)
+    {
+        assert(m_scheduler);
+        m_head = m_tail = new Node();
+    }
+
+    ~Strand()
+    {
+        while(m_head)
+        {
+            Node* next = m_head->next.load(std::memory_order_relaxed);
+            delete m_head;
+            m_head = next;
+        }
+    }
+
+    Strand(const Strand&) = delete;
+    Strand& operator=(const Strand&) = delete;
+
+    //投递任务，稍后在Strand中执行
+    void post(TaskFn fn)
+    {
+        Node* node = new Node();
+        node->fn = std::move(fn);
+        Node* prev = m_tail.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+
+        //队列从空变为非空，由这次投递负责提交排空任务
+        if(m_count.fetch_add(1, std::memory_order_acq_rel) == 0)
+        {
+            scheduleDrain();
+        }
+    }
+
+    //已经在这个Strand中时直接执行，否则投递
+    void dispatch(TaskFn fn)
+    {
+        if(runningInThisStrand())
+        {
+            fn();
+            return;
+        }
+        post(std::move(fn));
+    }
+
+    //当前协程是否正在执行这个Strand的任务
+    bool runningInThisStrand() const
+    {
+        uint64_t id = Fiber::getFiberId();
+        return id != (uint64_t)-1 && m_running_fiber.load(std::memory_order_acquire) == id;
+    }
+
+    Scheduler* getScheduler() const { return m_scheduler;}
+
+private:
+    struct Node
+    {
+        TaskFn fn;
+        std::atomic<Node*> next = {nullptr};
+    };
+
+    //一次排空最多执行的任务数，超过后重新排队，避免一个繁忙的Strand长期占用工作线程
+    static const int MAX_BATCH = 64;
+
+    void scheduleDrain()
+    {
+        std::shared_ptr<Strand> self = shared_from_this();
+        m_scheduler->scheduleLock([self]()
+        {
+            self->drain();
+        });
+    }
+
+    //只有持有排空权的协程调用，单消费者
+    TaskFn pop()
+    {
+        Node* head = m_head;
+        Node* next = head->next.load(std::memory_order_acquire);
+        //计数已经增加但生产者还没有链接上节点，稍等即可
+        while(!next)
+        {
+            std::this_thread::yield();
+            next = head->next.load(std::memory_order_acquire);
+        }
+        m_head = next;
+        delete head;
+        return std::move(next->fn); //next成为新的哨兵节点
+    }
+
+    void drain()
+    {
+        m_running_fiber.store(Fiber::getFiberId(), std::memory_order_release);
+        for(int i = 0; i < MAX_BATCH; ++i)
+        {
+            TaskFn fn = pop();
+            fn();
+            //协程可能在fn中迁移到其他线程，但排空权一直在这个协程上
+            m_running_fiber.store(Fiber::getFiberId(), std::memory_order_release);
+
+            if(m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                m_running_fiber.store((uint64_t)-1, std::memory_order_release);
+                return;
+            }
+        }
+
+        //还有任务，让出工作线程后继续
+        m_running_fiber.store((uint64_t)-1, std::memory_order_release);
+        scheduleDrain();
+    }
+
+private:
+    Scheduler* m_scheduler;
+    //消费者端，只由持有排空权的协程访问
+    Node* m_head;
+    std::atomic<Node*> m_tail;
+    //已投递但还没有执行完的任务数
+    std::atomic<size_t> m_count = {0};
+    //正在执行任务的协程id
+    std::atomic<uint64_t> m_running_fiber = {(uint64_t)-1};
+};
+
+// 按key把任务分配到固定数量的Strand上：同一个key的任务串行执行，不同key大概率并行
+template <class Key, class Hash = std::hash<Key>>
+class StrandPool
+{
+public:
+    explicit StrandPool(size_t size, Scheduler* scheduler = Scheduler::getThis())
+    {
+        assert(size > 0);
+        m_strands.reserve(size);
+        for(size_t i = 0; i < size; ++i)
+        {
+            m_strands.push_back(std::make_shared<Strand>(scheduler));
+        }
+    }
+
+    const std::shared_ptr<Strand>& get(const Key& key) const
+    {
+        return m_strands[Hash()(key) % m_strands.size()];
+    }
+
+    void post(const Key& key, TaskFn fn)
+    {
+        get(key)->post(std::move(fn));
+    }
+
+private:
+    std::vector<std::shared_ptr<Strand>> m_strands;
+};
@@ -0,0 +1,359 @@
+#pragma once
+
+// C++20无栈协程：Task<T>和调度器、IOManager的awaiter。
+// 无栈协程和Fiber共用同一个调度器的任务队列：被唤醒时协程句柄放入任务队列，由工作线程在调度协程上直接恢复，
+// 不需要分配Fiber和128K的栈，协程帧只有几百字节。
+// 协程体内不能调用会挂起Fiber的接口(hook的阻塞IO、Future::get()、FiberMutex等)，应当使用这里的awaiter。
+// 协程有自己的取消令牌、截止时间和FiberLocal(co_await的子协程和它共用)：恢复时换到调度协程上，
+// 挂起时换出保存在协程帧中，协程结束时销毁，同一个调度协程上的其他协程看不到。
+// scheduleInline的回调等直接在调度协程上执行的代码不在任何协程中，不应当设置这些状态。
+// 需要以C++20编译，否则这个头文件为空。
+#ifdef __cpp_impl_coroutine
+
+#include "ioscheduler.h"
+#include "future.h"
+
+#include <coroutine>
+#include <optional>
+#include <exception>
+#include <utility>
+
+template <class T>
+class Task;
+
+namespace detail
+{
+    //包装协程体中co_await的awaiter：挂起之前把协程的上下文从调度协程换出，恢复之后换回。
+    //Awaiter是引用时直接使用co_await的操作数，它是完整表达式中的临时对象，在挂起期间一直有效。
+    //挂起之后协程可能立即在其他线程恢复，调用inner.await_suspend()之后不能再访问成员
+    template <class Awaiter>
+    struct ContextAwaiter
+    {
+        template <class U>
+        ContextAwaiter(U&& a, Fiber::Context* ctx) : inner(std::forward<U>(a)), context(ctx) {}
+
+        Awaiter inner;
+        Fiber::Context* context;
+        bool swapped = false;
+
+        bool await_ready() { return inner.await_ready(); }
+
+        auto await_suspend(std::coroutine_handle<> h)
+        {
+            Fiber::getThisPtr()->swapContext(*context);
+            swapped = true;
+            return inner.await_suspend(h);
+        }
+
+        decltype(auto) await_resume()
+        {
+            if(swapped)
+            {
+                Fiber::getThisPtr()->swapContext(*context);
+                swapped = false;
+            }
+            return inner.await_resume();
+        }
+    };
+
+    template <class T>
+    struct IsTask : std::false_type {};
+
+    template <class T>
+    struct IsTask<Task<T>> : std::true_type {};
+
+    struct TaskPromiseBase
+    {
+        //co_await这个Task的协程，结束时恢复它
+        std::coroutine_handle<> continuation;
+        //没有人等待、结束时自行销毁
+        bool detached = false;
+        std::exception_ptr exception;
+        //挂起期间保存的上下文
+        Fiber::Context context;
+
+        //co_await子协程是对称转移，上下文留在调度协程上由子协程继续使用；其他awaiter挂起时换出上下文
+        template <class A>
+        decltype(auto) await_transform(A&& a)
+        {
+            if constexpr(IsTask<std::decay_t<A>>::value)
+            {
+                return std::forward<A>(a).operator co_await();
+            }
+            else if constexpr(requires { std::forward<A>(a).operator co_await(); })
+            {
+                typedef decltype(std::forward<A>(a).operator co_await()) Inner;
+                return ContextAwaiter<Inner>(std::forward<A>(a).operator co_await(), &context);
+            }
+            else
+            {
+                return ContextAwaiter<std::remove_reference_t<A>&>(a, &context);
+            }
+        }
+
+        //惰性启动：被co_await或coSpawn时才开始执行
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+
+            template <class Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+            {
+                TaskPromiseBase& promise = h.promise();
+                if(promise.continuation)
+                {
+                    //对称转移，直接恢复等待者，不增加调用栈深度
+                    return promise.continuation;
+                }
+                //最外层的协程结束，在调度协程上销毁它的上下文，之后执行的协程和回调看不到
+                Fiber::getThisPtr()->resetContext();
+                if(promise.detached)
+                {
+                    h.destroy();
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() { exception = std::current_exception(); }
+
+        void rethrowIfFailed()
+        {
+            if(exception)
+            {
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+
+    template <class T>
+    struct TaskPromise : public TaskPromiseBase
+    {
+        std::optional<T> value;
+
+        Task<T> get_return_object();
+        void return_value(T v) { value.emplace(std::move(v)); }
+
+        T result()
+        {
+            rethrowIfFailed();
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct TaskPromise<void> : public TaskPromiseBase
+    {
+        Task<void> get_return_object();
+        void return_void() {}
+
+        void result() { rethrowIfFailed(); }
+    };
+}
+
+// 协程任务，只能移动。在另一个协程中co_await它得到返回值(或重新抛出异常)，
+// 在普通函数或Fiber中通过coSpawn放入调度器执行
+template <class T>
+class Task
+{
+public:
+    typedef detail::TaskPromise<T> promise_type;
+
+    Task() = default;
+    explicit Task(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(m_handle)
+            {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        if(m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    bool valid() const { return (bool)m_handle; }
+
+    //交出协程句柄的所有权
+    std::coroutine_handle<promise_type> release() { return std::exchange(m_handle, nullptr); }
+
+    struct Awaiter
+    {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() const noexcept { return handle.done(); }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+        {
+            handle.promise().continuation = continuation;
+            return handle;
+        }
+
+        T await_resume() { return handle.promise().result(); }
+    };
+
+    Awaiter operator co_await() && noexcept
+    {
+        assert(m_handle);
+        return Awaiter{m_handle};
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace detail
+{
+    template <class T>
+    Task<T> TaskPromise<T>::get_return_object()
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object()
+    {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+    //执行task并把结果写入promise，供coSpawn使用
+    template <class T>
+    Task<void> runTask(Task<T> task, std::shared_ptr<Promise<T>> promise)
+    {
+        try
+        {
+            promise->setValue(co_await std::move(task));
+        }
+        catch(...)
+        {
+            promise->setException(std::current_exception());
+        }
+    }
+
+    inline Task<void> runTask(Task<void> task, std::shared_ptr<Promise<void>> promise)
+    {
+        try
+        {
+            co_await std::move(task);
+            promise->setValue();
+        }
+        catch(...)
+        {
+            promise->setException(std::current_exception());
+        }
+    }
+}
+
+// 把协程放入调度器执行，返回获取结果的Future(Fiber中可以get()等待，协程中不行)
+template <class T>
+Future<T> coSpawn(Task<T> task, Scheduler* scheduler = Scheduler::getThis())
+{
+    assert(scheduler && task.valid());
+    std::shared_ptr<Promise<T>> promise = std::make_shared<Promise<T>>();
+    Future<T> future = promise->getFuture();
+
+    auto handle = detail::runTask(std::move(task), promise).release();
+    handle.promise().detached = true;
+    scheduler->scheduleLock(std::coroutine_handle<>(handle), -1);
+    return future;
+}
+
+
+// co_await scheduleOn(scheduler)：切换到scheduler(的指定线程)上继续执行
+struct ScheduleAwaiter
+{
+    Scheduler* scheduler;
+    int thread;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) { scheduler->scheduleLock(h, thread); }
+    void await_resume() noexcept {}
+};
+
+inline ScheduleAwaiter scheduleOn(Scheduler* scheduler = Scheduler::getThis(), int thread = -1)
+{
+    return ScheduleAwaiter{scheduler, thread};
+}
+
+// co_await waitEvent(fd, event)：等待fd可读/可写，返回0；登记事件失败返回-1
+struct EventAwaiter
+{
+    IOManager* iom;
+    int fd;
+    IOManager::Event event;
+    int rt = 0;
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        IOManager* manager = iom;
+        //回调只是把协程放回队列，不需要为它创建Fiber
+        int r = manager->addEvent(fd, event, [manager, h]()
+        {
+            manager->scheduleLock(h, -1);
+        }, true);
+        //登记成功后协程可能已经在其他线程恢复，awaiter随之销毁，不能再访问成员
+        if(r)
+        {
+            rt = r;
+            return false;
+        }
+        return true;
+    }
+
+    int await_resume() const noexcept { return rt; }
+};
+
+inline EventAwaiter waitEvent(int fd, IOManager::Event event, IOManager* iom = IOManager::getThis())
+{
+    return EventAwaiter{iom, fd, event};
+}
+
+// co_await sleepFor(ms)：挂起协程ms毫秒
+struct SleepAwaiter
+{
+    IOManager* iom;
+    uint64_t ms;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        IOManager* manager = iom;
+        manager->addTimer(ms, [manager, h]()
+        {
+            manager->scheduleLock(h, -1);
+        }, false, true);
+    }
+
+    void await_resume() noexcept {}
+};
+
+inline SleepAwaiter sleepFor(uint64_t ms, IOManager* iom = IOManager::getThis())
+{
+    return SleepAwaiter{iom, ms};
+}
+
+#endif
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+// 只能移动的void()可调用对象，用于调度路径(scheduleLock、ScheduleTask、Fiber、Timer)代替std::function<void()>。
+// 不超过INLINE_SIZE字节的函数对象直接存放在对象内部，不分配堆内存；在任务队列、协程和定时器之间传递时只移动不复制。
+// 可以保存捕获了unique_ptr等只能移动的对象的lambda，较大的函数对象退化为在堆上分配。
+class TaskFn
+{
+public:
+    //内联缓冲区大小，加上操作表指针整个对象为64字节，一条缓存行
+    static const size_t INLINE_SIZE = 48;
+
+    TaskFn() noexcept = default;
+    TaskFn(std::nullptr_t) noexcept {}
+
+    template <class F, class D = typename std::decay<F>::type,
+              class = typename std::enable_if<!std::is_same<D, TaskFn>::value && std::is_invocable_r<void, D&>::value>::type>
+    TaskFn(F&& f)
+    {
+        //空的std::function和空函数指针保持为空，和std::function的行为一致
+        if(isNull(f))
+        {
+            return;
+        }
+        if constexpr(fitsInline<D>())
+        {
+            new (m_storage) D(std::forward<F>(f));
+            m_ops = &s_inline_ops<D>;
+        }
+        else
+        {
+            *reinterpret_cast<D**>(m_storage) = new D(std::forward<F>(f));
+            m_ops = &s_heap_ops<D>;
+        }
+    }
+
+    TaskFn(TaskFn&& other) noexcept
+    {
+        moveFrom(other);
+    }
+
+    TaskFn& operator=(TaskFn&& other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    TaskFn& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    TaskFn(const TaskFn&) = delete;
+    TaskFn& operator=(const TaskFn&) = delete;
+
+    ~TaskFn()
+    {
+        reset();
+    }
+
+    void operator()()
+    {
+        m_ops->invoke(m_storage);
+    }
+
+    explicit operator bool() const noexcept { return m_ops != nullptr; }
+
+    bool operator==(std::nullptr_t) const noexcept { return m_ops == nullptr; }
+    bool operator!=(std::nullptr_t) const noexcept { return m_ops != nullptr; }
+
+    void swap(TaskFn& other) noexcept
+    {
+        TaskFn tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+private:
+    //按存放方式生成的操作表，代替虚函数
+    struct Ops
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src) noexcept;    //把src中的对象移动到dst并销毁src中的对象
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template <class D>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(D) <= INLINE_SIZE && alignof(D) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<D>::value;
+    }
+
+    template <class D>
+    static void inlineInvoke(void* storage) { (*static_cast<D*>(storage))(); }
+
+    template <class D>
+    static void inlineMove(void* dst, void* src) noexcept
+    {
+        new (dst) D(std::move(*static_cast<D*>(src)));
+        static_cast<D*>(src)->~D();
+    }
+
+    template <class D>
+    static void inlineDestroy(void* storage) noexcept { static_cast<D*>(storage)->~D(); }
+
+    template <class D>
+    static void heapInvoke(void* storage) { (**static_cast<D**>(storage))(); }
+
+    template <class D>
+    static void heapMove(void* dst, void* src) noexcept { *static_cast<D**>(dst) = *static_cast<D**>(src); }
+
+    template <class D>
+    static void heapDestroy(void* storage) noexcept { delete *static_cast<D**>(storage); }
+
+    template <class D>
+    static constexpr Ops s_inline_ops = {&inlineInvoke<D>, &inlineMove<D>, &inlineDestroy<D>};
+
+    template <class D>
+    static constexpr Ops s_heap_ops = {&heapInvoke<D>, &heapMove<D>, &heapDestroy<D>};
+
+    template <class T>
+    static bool isNull(const T&) { return false; }
+
+    template <class R, class... Args>
+    static bool isNull(R (*f)(Args...)) { return f == nullptr; }
+
+    template <class Sig>
+    static bool isNull(const std::function<Sig>& f) { return !f; }
+
+    void moveFrom(TaskFn& other) noexcept
+    {
+        if(other.m_ops)
+        {
+            other.m_ops->move(m_storage, other.m_storage);
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+    void reset() noexcept
+    {
+        if(m_ops)
+        {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char m_storage[INLINE_SIZE];
+    const Ops* m_ops = nullptr;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "scheduler.h"
+#include "fibersync.h"
+#include "cancellation.h"
+
+// 等待一组任务完成：add()增加计数，done()减少计数，wait()挂起当前协程直到计数归零
+class WaitGroup
+{
+public:
+    WaitGroup() = default;
+    WaitGroup(const WaitGroup&) = delete;
+    WaitGroup& operator=(const WaitGroup&) = delete;
+
+    void add(int n = 1)
+    {
+        m_count.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void done()
+    {
+        //不是最后一个时只需要一次原子操作
+        int count = m_count.load(std::memory_order_relaxed);
+        while(count > 1)
+        {
+            if(m_count.compare_exchange_weak(count, count - 1, std::memory_order_release))
+            {
+                return;
+            }
+        }
+
+        //最后一次在锁内归零：等待者在锁内看到0之后可能立即销毁WaitGroup，解锁之后不能再访问成员
+        WaitQueue waiters;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            //读到1之后并发的add()可能又增加了计数，只有真正归零时才唤醒等待者
+            if(m_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            {
+                return;
+            }
+            std::swap(waiters, m_waiters);
+        }
+        while(FiberWaiter* waiter = waiters.pop())
+        {
+            waiter->wake();
+        }
+    }
+
+    void wait()
+    {
+        FiberWaiter waiter;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_count.load(std::memory_order_acquire) == 0)
+            {
+                return;
+            }
+            m_waiters.push(&waiter);
+        }
+        waiter.park();
+    }
+
+private:
+    std::atomic<int> m_count = {0};
+    std::mutex m_mutex;
+    WaitQueue m_waiters;
+};
+
+// 结构化并发：spawn()启动的子任务都运行在组的取消令牌下，wait()等待全部完成。
+// 任意子任务抛出异常时取消整个组，挂起在hook的IO或sleep上的兄弟任务会返回ECANCELED，
+// wait()重新抛出第一个异常。组的令牌挂在创建者当前的令牌下，上层取消时子任务一并取消。
+// 析构时会等待所有子任务结束，子任务不会比组活得更久。
+class TaskGroup
+{
+public:
+    explicit TaskGroup(Scheduler* scheduler = Scheduler::getThis())
+        : m_scheduler(scheduler)
+    {
+        assert(m_scheduler);
+        std::shared_ptr<CancellationToken> parent = CancellationToken::getCurrent();
+        m_token = parent ? parent->createChild() : std::make_shared<CancellationToken>();
+    }
+
+    //析构时等待所有子任务结束
+    ~TaskGroup()
+    {
+        m_wg.wait();
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <class Fn>
+    void spawn(Fn fn)
+    {
+        m_wg.add(1);
+        //和Scheduler::spawn一样把fn移动进任务，只能移动的fn(例如捕获了unique_ptr)也可以spawn
+        m_scheduler->scheduleLock([this, fn = std::move(fn)]() mutable
+        {
+            {
+                CancellationScope scope(m_token);
+                try
+                {
+                    //组已经被取消的任务不再启动
+                    if(!m_token->isCancelled())
+                    {
+                        fn();
+                    }
+                }
+                catch(...)
+                {
+                    setException(std::current_exception());
+                }
+            }
+            m_wg.done();
+        });
+    }
+
+    //挂起当前协程直到所有子任务结束，有子任务失败时重新抛出第一个异常
+    void wait()
+    {
+        m_wg.wait();
+        if(m_exception)
+        {
+            std::exception_ptr eptr;
+            std::swap(eptr, m_exception);
+            std::rethrow_exception(eptr);
+        }
+    }
+
+    //取消所有子任务
+    void cancel() { m_token->cancel(); }
+    bool isCancelled() const { return m_token->isCancelled(); }
+
+    const std::shared_ptr<CancellationToken>& getToken() const { return m_token; }
+
+private:
+    void setException(std::exception_ptr eptr)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(!m_exception)
+            {
+                m_exception = eptr;
+            }
+        }
+        cancel();
+    }
+
+private:
+    Scheduler* m_scheduler;
+    std::shared_ptr<CancellationToken> m_token;
+
+    WaitGroup m_wg;
+    std::mutex m_mutex;
+    std::exception_ptr m_exception;
+};
@@ -13,7 +13,6 @@
 
 static int sock_listen_fd = -1;
 
-void test_accept();
 void error(const char *msg)
 {
     perror(msg);
@@ -21,71 +20,54 @@ void error(const char *msg)
     exit(1);
 }
 
-void watch_io_read()
+//由IOManager的acceptor批量accept出的新连接，fd已经是非阻塞的
+void handle_connection(int fd)
 {
-    IOManager::getThis()->addEvent(sock_listen_fd, IOManager::READ, test_accept);
-}
-
-void test_accept()
-{
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    socklen_t len = sizeof(addr);
-    int fd = accept(sock_listen_fd, (struct sockaddr *)&addr, &len);
-    if (fd < 0)
-    {
-        //std::cout << "accept failed, fd = " << fd << ", errno = " << errno << std::endl;
-    }
-    else
+    std::cout << "accepted connection, fd = " << fd << std::endl;
+    IOManager::getThis()->addEvent(fd, IOManager::READ, [fd]()
     {
-        std::cout << "accepted connection, fd = " << fd << std::endl;
-        fcntl(fd, F_SETFL, O_NONBLOCK);
-        IOManager::getThis()->addEvent(fd, IOManager::READ, [fd]()
+        char buffer[1024];
+        memset(buffer, 0, sizeof(buffer));
+        while (true)
         {
-            char buffer[1024];
-            memset(buffer, 0, sizeof(buffer));
-            while (true)
+            int ret = recv(fd, buffer, sizeof(buffer), 0);
+            if (ret > 0)
             {
-                int ret = recv(fd, buffer, sizeof(buffer), 0);
-                if (ret > 0)
-                {
-                    // 打印接收到的数据
-                    //std::cout << "received data, fd = " << fd << ", data = " << buffer << std::endl;
-                    
-                    // 构建HTTP响应
-                    const char *response = "HTTP/1.1 200 OK\r\n"
-                                           "Content-Type: text/plain\r\n"
-                                           "Content-Length: 13\r\n"
-                                           "Connection: keep-alive\r\n"
-                                           "\r\n"
-                                           "Hello, World!";
-                    
-                    // 发送HTTP响应
-                    ret = send(fd, response, strlen(response), 0);
-                   // std::cout << "sent data, fd = " << fd << ", ret = " << ret << std::endl;
+                // 打印接收到的数据
+                //std::cout << "received data, fd = " << fd << ", data = " << buffer << std::endl;
+                
+                // 构建HTTP响应
+                const char *response = "HTTP/1.1 200 OK\r\n"
+                                       "Content-Type: text/plain\r\n"
+                                       "Content-Length: 13\r\n"
+                                       "Connection: keep-alive\r\n"
+                                       "\r\n"
+                                       "Hello, World!";
+                
+                // 发送HTTP响应
+                ret = send(fd, response, strlen(response), 0);
+               // std::cout << "sent data, fd = " << fd << ", ret = " << ret << std::endl;
 
-                    // 关闭连接
-                     close(fd);
-                     break;
+                // 关闭连接
+                 close(fd);
+                 break;
+            }
+            if (ret <= 0)
+            {
+                if (ret == 0 || errno != EAGAIN)
+                {
+                    //std::cout << "closing connection, fd = " << fd << std::endl;
+                    close(fd);
+                    break;
                 }
-                if (ret <= 0)
+                else if (errno == EAGAIN)
                 {
-                    if (ret == 0 || errno != EAGAIN)
-                    {
-                        //std::cout << "closing connection, fd = " << fd << std::endl;
-                        close(fd);
-                        break;
-                    }
-                    else if (errno == EAGAIN)
-                    {
-                        //std::cout << "recv returned EAGAIN, fd = " << fd << std::endl;
-                        //std::this_thread::sleep_for(std::chrono::milliseconds(50)); // 延长睡眠时间，避免繁忙等待
-                    }
+                    //std::cout << "recv returned EAGAIN, fd = " << fd << std::endl;
+                    //std::this_thread::sleep_for(std::chrono::milliseconds(50)); // 延长睡眠时间，避免繁忙等待
                 }
             }
-        });
-    }
-    IOManager::getThis()->addEvent(sock_listen_fd, IOManager::READ, test_accept);
+        }
+    });
 }
 
 void test_iomanager()
@@ -120,9 +102,8 @@ void test_iomanager()
     }
 
     printf("epoll echo server listening for connections on port: %d\n", portno);
-    fcntl(sock_listen_fd, F_SETFL, O_NONBLOCK);
     IOManager iom(9);
-    iom.addEvent(sock_listen_fd, IOManager::READ, test_accept);
+    iom.addAcceptor(sock_listen_fd, handle_connection);
 }
 
 int main(int argc, char *argv[])
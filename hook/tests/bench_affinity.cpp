@@ -0,0 +1,171 @@
+// 工作线程绑核对比：同一个echo服务器分别在不绑定、AFFINITY_CORE、AFFINITY_NODE下运行，
+// 客户端是普通线程(不开启hook，不受绑定影响)，每个客户端一个长连接循环发送64字节并等待回显。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/bench_affinity.cpp $(ls *.cpp | grep -v '^test.cpp$') -o bench_affinity -ldl -lpthread
+// 运行: ./bench_affinity [工作线程数=CPU数] [客户端数=64] [每种策略的秒数=3]
+
+#include "ioscheduler.h"
+#include "hook.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+static const size_t MESSAGE_SIZE = 64;
+
+//每个连接一个协程，读到多少写回多少
+static void echo_connection(int fd)
+{
+    IOManager::getThis()->scheduleLock([fd]()
+    {
+        char buf[4096];
+        while(true)
+        {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if(n <= 0)
+            {
+                break;
+            }
+            if(send(fd, buf, n, 0) != n)
+            {
+                break;
+            }
+        }
+        close(fd);
+    });
+}
+
+static int listen_on_any_port(int* port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0)
+    {
+        perror("listen");
+        exit(1);
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+//客户端线程：连接后循环发送、等待完整回显，统计往返次数
+static void client(int port, double seconds, std::atomic<long>& round_trips)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+
+    char msg[MESSAGE_SIZE];
+    memset(msg, 'x', sizeof(msg));
+    char buf[MESSAGE_SIZE];
+    long count = 0;
+    auto start = std::chrono::steady_clock::now();
+    while(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < seconds)
+    {
+        if(send(fd, msg, sizeof(msg), 0) != (ssize_t)sizeof(msg))
+        {
+            break;
+        }
+        size_t got = 0;
+        while(got < sizeof(buf))
+        {
+            ssize_t n = recv(fd, buf + got, sizeof(buf) - got, 0);
+            if(n <= 0)
+            {
+                close(fd);
+                round_trips += count;
+                return;
+            }
+            got += n;
+        }
+        ++count;
+    }
+    close(fd);
+    round_trips += count;
+}
+
+static double run(const char* name, int policy, int workers, int clients, double seconds)
+{
+    int port = 0;
+    int listen_fd = listen_on_any_port(&port);
+    std::atomic<long> round_trips = {0};
+    {
+        //use_caller的主线程在析构之前不参与调度，这里多建一个线程保证有workers个线程在工作
+        IOManager iom(workers + 1, true);
+        if(policy >= 0)
+        {
+            iom.setAffinity((Scheduler::AffinityPolicy)policy);
+            //setAffinity也绑定了调用它的主线程，客户端线程从主线程继承绑定，这里恢复
+            std::vector<int> all;
+            for(auto& node : Thread::getNumaNodes())
+            {
+                all.insert(all.end(), node.begin(), node.end());
+            }
+            Thread::setCurrentAffinity(all);
+        }
+        iom.addAcceptor(listen_fd, echo_connection);
+
+        std::vector<std::thread> threads;
+        for(int i = 0; i < clients; ++i)
+        {
+            threads.emplace_back(client, port, seconds, std::ref(round_trips));
+        }
+        for(auto& t : threads)
+        {
+            t.join();
+        }
+        iom.delAcceptor(listen_fd);
+    }
+    close(listen_fd);
+
+    double rate = round_trips / seconds;
+    std::cout << name << ": " << (long)rate << " round trips/s" << std::endl;
+    return rate;
+}
+
+int main(int argc, char *argv[])
+{
+    int cpus = 0;
+    for(auto& node : Thread::getNumaNodes())
+    {
+        cpus += node.size();
+    }
+    int workers = argc > 1 ? atoi(argv[1]) : cpus;
+    int clients = argc > 2 ? atoi(argv[2]) : 64;
+    double seconds = argc > 3 ? atof(argv[3]) : 3;
+    std::cout << "cpus=" << cpus << " numa_nodes=" << Thread::getNumaNodes().size()
+              << " workers=" << workers << " clients=" << clients << std::endl;
+
+    run("unpinned     ", -1, workers, clients, seconds);
+    run("AFFINITY_CORE", Scheduler::AFFINITY_CORE, workers, clients, seconds);
+    run("AFFINITY_NODE", Scheduler::AFFINITY_NODE, workers, clients, seconds);
+    return 0;
+}
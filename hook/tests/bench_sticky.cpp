@@ -0,0 +1,224 @@
+// 软亲和(setStickyWindow)对比：echo服务器的每个连接协程有自己的工作集(每次请求都读写一遍)，
+// 在recv上挂起后由IO事件唤醒。分别统计关闭和打开亲和窗口时的吞吐量、协程在另一个线程恢复的比例，
+// 以及硬件缓存未命中数(perf_event_open，不可用时输出n/a)。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/bench_sticky.cpp $(ls *.cpp | grep -v '^test.cpp$') -o bench_sticky -ldl -lpthread
+// 运行: ./bench_sticky [工作线程数=4] [客户端数=32] [每种窗口的秒数=3] [工作集KB=32]
+
+#include "ioscheduler.h"
+#include "hook.h"
+
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+static const size_t MESSAGE_SIZE = 64;
+static size_t s_working_set = 32 * 1024;
+
+static std::atomic<long> s_resumes = {0};
+static std::atomic<long> s_migrations = {0};
+
+//每个连接一个协程。每个请求把连接自己的工作集读写一遍，模拟请求处理的数据
+static void echo_connection(int fd)
+{
+    IOManager::getThis()->scheduleLock([fd]()
+    {
+        std::vector<char> state(s_working_set, 1);
+        char buf[MESSAGE_SIZE];
+        long resumes = 0;
+        long migrations = 0;
+        while(true)
+        {
+            int before = Thread::getThreadId();
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if(n <= 0)
+            {
+                break;
+            }
+            ++resumes;
+            if(Thread::getThreadId() != before)
+            {
+                ++migrations;
+            }
+
+            unsigned sum = 0;
+            for(size_t i = 0; i < state.size(); i += 64)
+            {
+                sum += state[i];
+                state[i] = (char)sum;
+            }
+            buf[0] = (char)sum;
+
+            if(send(fd, buf, n, 0) != n)
+            {
+                break;
+            }
+        }
+        s_resumes += resumes;
+        s_migrations += migrations;
+        close(fd);
+    });
+}
+
+static int listen_on_any_port(int* port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0)
+    {
+        perror("listen");
+        exit(1);
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static void client(int port, double seconds, std::atomic<long>& round_trips)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+
+    char msg[MESSAGE_SIZE];
+    memset(msg, 'x', sizeof(msg));
+    char buf[MESSAGE_SIZE];
+    long count = 0;
+    auto start = std::chrono::steady_clock::now();
+    while(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < seconds)
+    {
+        if(send(fd, msg, sizeof(msg), 0) != (ssize_t)sizeof(msg))
+        {
+            break;
+        }
+        size_t got = 0;
+        while(got < sizeof(buf))
+        {
+            ssize_t n = recv(fd, buf + got, sizeof(buf) - got, 0);
+            if(n <= 0)
+            {
+                close(fd);
+                round_trips += count;
+                return;
+            }
+            got += n;
+        }
+        ++count;
+    }
+    close(fd);
+    round_trips += count;
+}
+
+//统计整个进程(包括之后创建的线程)的硬件缓存未命中，不支持时返回-1
+static int open_cache_miss_counter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void run(uint64_t window_us, int workers, int clients, double seconds)
+{
+    int port = 0;
+    int listen_fd = listen_on_any_port(&port);
+    std::atomic<long> round_trips = {0};
+    s_resumes = 0;
+    s_migrations = 0;
+
+    //计数器要在工作线程创建之前打开，inherit才会覆盖它们
+    int perf_fd = open_cache_miss_counter();
+    int perf_errno = errno;
+    if(perf_fd >= 0)
+    {
+        ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    {
+        IOManager iom(workers + 1, true);
+        iom.setStickyWindow(window_us);
+        iom.addAcceptor(listen_fd, echo_connection);
+
+        std::vector<std::thread> threads;
+        for(int i = 0; i < clients; ++i)
+        {
+            threads.emplace_back(client, port, seconds, std::ref(round_trips));
+        }
+        for(auto& t : threads)
+        {
+            t.join();
+        }
+        iom.delAcceptor(listen_fd);
+    }
+    close(listen_fd);
+
+    std::string misses = "n/a (perf_event_open: " + std::string(strerror(perf_errno)) + ")";
+    if(perf_fd >= 0)
+    {
+        ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t value = 0;
+        if(read(perf_fd, &value, sizeof(value)) == sizeof(value) && round_trips > 0)
+        {
+            misses = std::to_string(value / round_trips) + "/request (whole process, clients included)";
+        }
+        close(perf_fd);
+    }
+
+    double migrated = s_resumes ? 100.0 * s_migrations / s_resumes : 0;
+    std::cout << "window=" << window_us << "us: " << (long)(round_trips / seconds) << " round trips/s, "
+              << migrated << "% resumed on another thread, cache misses " << misses << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int workers = argc > 1 ? atoi(argv[1]) : 4;
+    int clients = argc > 2 ? atoi(argv[2]) : 32;
+    double seconds = argc > 3 ? atof(argv[3]) : 3;
+    if(argc > 4)
+    {
+        s_working_set = atoi(argv[4]) * 1024;
+    }
+    std::cout << "cpus=" << std::thread::hardware_concurrency() << " workers=" << workers
+              << " clients=" << clients << " working_set=" << s_working_set / 1024 << "KB" << std::endl;
+
+    run(0, workers, clients, seconds);
+    run(50, workers, clients, seconds);
+    run(500, workers, clients, seconds);
+    return 0;
+}
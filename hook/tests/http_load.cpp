@@ -0,0 +1,138 @@
+// 短连接HTTP压测客户端：保持conns个并发连接，每个连接connect、发送一个请求、读到对端关闭后重新连接，
+// 持续seconds秒，输出每秒完成的请求(也就是每秒新建的连接)和延迟分位数。
+// 单线程epoll实现，不依赖hook库，用来对比 hook/test.cpp 和 epoll/main.cpp 两个服务器。
+//
+// 编译: g++ -std=c++17 -O2 tests/http_load.cpp -o http_load
+// 运行: ./http_load <port> [conns=64] [seconds=5]
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+struct Conn
+{
+    int fd = -1;
+    bool sent = false;
+    std::chrono::steady_clock::time_point start;
+};
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <port> [conns=64] [seconds=5]\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    int conns_count = argc > 2 ? atoi(argv[2]) : 64;
+    double seconds = argc > 3 ? atof(argv[3]) : 5;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    int epfd = epoll_create1(0);
+    std::vector<Conn> conns(conns_count);
+    long done = 0;
+    long errors = 0;
+    std::vector<double> latencies;
+
+    auto open_conn = [&](int i)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        conns[i].fd = fd;
+        conns[i].sent = false;
+        conns[i].start = std::chrono::steady_clock::now();
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLOUT | EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+    };
+
+    auto close_conn = [&](int i)
+    {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, conns[i].fd, nullptr);
+        close(conns[i].fd);
+    };
+
+    for(int i = 0; i < conns_count; ++i)
+    {
+        open_conn(i);
+    }
+
+    const char *request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    epoll_event events[256];
+    auto begin = std::chrono::steady_clock::now();
+    while(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < seconds)
+    {
+        int n = epoll_wait(epfd, events, 256, 100);
+        for(int k = 0; k < n; ++k)
+        {
+            int i = events[k].data.u32;
+            Conn& conn = conns[i];
+
+            //连接建立后发送请求
+            if(!conn.sent && (events[k].events & EPOLLOUT))
+            {
+                if(send(conn.fd, request, strlen(request), MSG_NOSIGNAL) < 0)
+                {
+                    ++errors;
+                    close_conn(i);
+                    open_conn(i);
+                    continue;
+                }
+                conn.sent = true;
+
+                epoll_event event;
+                memset(&event, 0, sizeof(event));
+                event.events = EPOLLIN;
+                event.data.u32 = i;
+                epoll_ctl(epfd, EPOLL_CTL_MOD, conn.fd, &event);
+            }
+
+            //读到服务器关闭连接算作完成一个请求
+            if(conn.sent && (events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+            {
+                char buf[4096];
+                ssize_t rt;
+                while((rt = recv(conn.fd, buf, sizeof(buf), 0)) > 0);
+                if(rt == 0 || errno != EAGAIN)
+                {
+                    if(rt == 0)
+                    {
+                        ++done;
+                        latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - conn.start).count());
+                    }
+                    else
+                    {
+                        ++errors;
+                    }
+                    close_conn(i);
+                    open_conn(i);
+                }
+            }
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::sort(latencies.begin(), latencies.end());
+    double p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+    double p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+    printf("conns=%d requests=%ld errors=%ld rate=%.0f/s p50=%.2fms p99=%.2fms\n",
+           conns_count, done, errors, done / elapsed, p50, p99);
+    return 0;
+}
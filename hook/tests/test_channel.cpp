@@ -0,0 +1,354 @@
+// Channel<T>的行为测试和吞吐量测试。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/test_channel.cpp $(ls *.cpp | grep -v '^test.cpp$') -o test_channel -ldl -lpthread
+// 运行: ./test_channel [消息数=1000000]
+
+#include "channel.h"
+#include "ioscheduler.h"
+#include "hook.h"
+
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+            exit(1); \
+        } \
+    } while(0)
+
+static std::atomic<int> live_count = {0};
+
+//没有默认构造函数的类型，用来检查通道析构时只销毁还在队列中的元素
+struct NonDefault
+{
+    explicit NonDefault(int v) : value(v) { ++live_count; }
+    NonDefault(NonDefault&& other) : value(other.value) { ++live_count; }
+    NonDefault& operator=(NonDefault&& other) { value = other.value; return *this; }
+    ~NonDefault() { --live_count; }
+    int value;
+};
+
+void test_try_ops()
+{
+    Channel<int> ch(5);
+    //容量向上取整到2的幂
+    CHECK(ch.capacity() == 8);
+    for(int i = 0; i < 8; ++i)
+    {
+        CHECK(ch.trySend(int(i)));
+    }
+    CHECK(!ch.trySend(8));
+    CHECK(ch.size() == 8);
+
+    int out = -1;
+    for(int i = 0; i < 8; ++i)
+    {
+        CHECK(ch.tryRecv(out) && out == i);
+    }
+    CHECK(!ch.tryRecv(out));
+    std::cout << "try ops: ok" << std::endl;
+}
+
+void test_close()
+{
+    Channel<int> ch(4);
+    ch.trySend(1);
+    ch.trySend(2);
+    ch.close();
+    CHECK(ch.isClosed());
+    CHECK(!ch.send(3));
+
+    //关闭后仍然能取完剩余元素
+    int out = 0;
+    CHECK(ch.recv(out) && out == 1);
+    CHECK(ch.recv(out) && out == 2);
+    CHECK(!ch.recv(out));
+    std::cout << "close: ok" << std::endl;
+}
+
+void test_non_default()
+{
+    {
+        Channel<NonDefault> ch(8);
+        for(int i = 0; i < 10; ++i)
+        {
+            ch.trySend(NonDefault(i));
+        }
+        NonDefault out(-1);
+        CHECK(ch.tryRecv(out) && out.value == 0);
+        CHECK(ch.size() == 7);
+        CHECK(live_count == 8);
+    }
+    CHECK(live_count == 0);
+
+    //只能移动的类型
+    Channel<std::unique_ptr<int>> ch(2);
+    CHECK(ch.trySend(std::unique_ptr<int>(new int(7))));
+    std::unique_ptr<int> p;
+    CHECK(ch.tryRecv(p) && *p == 7);
+    std::cout << "non-default T: ok" << std::endl;
+}
+
+//多个协程生产、多个协程消费，容量很小以便频繁挂起
+void test_fibers()
+{
+    const int producers = 4;
+    const int consumers = 3;
+    const int per_producer = 20000;
+    Channel<int> ch(16);
+    std::atomic<long> sum = {0};
+    std::atomic<int> received = {0};
+    std::atomic<int> producers_left = {producers};
+    {
+        IOManager iom(2, true);
+        for(int p = 0; p < producers; ++p)
+        {
+            iom.scheduleLock([&ch, &producers_left, p]()
+            {
+                for(int i = 1; i <= per_producer; ++i)
+                {
+                    CHECK(ch.send(p * per_producer + i));
+                }
+                if(--producers_left == 0)
+                {
+                    ch.close();
+                }
+            });
+        }
+        for(int c = 0; c < consumers; ++c)
+        {
+            iom.scheduleLock([&ch, &sum, &received]()
+            {
+                int v;
+                while(ch.recv(v))
+                {
+                    sum += v;
+                    ++received;
+                }
+            });
+        }
+    }
+    long n = (long)producers * per_producer;
+    CHECK(received == n);
+    CHECK(sum == n * (n + 1) / 2);
+    std::cout << "fiber producers/consumers: ok" << std::endl;
+}
+
+void test_timeout_and_select()
+{
+    Channel<int> a(4);
+    Channel<int> b(4);
+    std::atomic<bool> done = {false};
+    {
+        IOManager iom(1, true);
+        iom.scheduleLock([&]()
+        {
+            //空通道超时
+            int out = 0;
+            auto start = std::chrono::steady_clock::now();
+            CHECK(!a.recv(out, 50));
+            CHECK(errno == ETIMEDOUT);
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            CHECK(elapsed >= 50);
+
+            //另一个协程稍后往b发送，select返回b的下标
+            IOManager::getThis()->scheduleLock([&b]()
+            {
+                usleep(20 * 1000);
+                b.send(42);
+            });
+            std::vector<Channel<int>*> chans = {&a, &b};
+            CHECK(Channel<int>::select(chans, out, 1000) == 1);
+            CHECK(out == 42);
+
+            //全部关闭后返回-1、errno为EPIPE
+            a.close();
+            b.close();
+            CHECK(Channel<int>::select(chans, out) == -1);
+            CHECK(errno == EPIPE);
+            done = true;
+        });
+    }
+    CHECK(done);
+    std::cout << "timeout/select: ok" << std::endl;
+}
+
+// 对照组：std::mutex + std::condition_variable 的有界队列
+class LockedQueue
+{
+public:
+    explicit LockedQueue(size_t capacity) : m_capacity(capacity) {}
+
+    void send(int v)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this]() { return m_queue.size() < m_capacity; });
+        m_queue.push_back(v);
+        m_not_empty.notify_one();
+    }
+
+    bool recv(int& v)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this]() { return !m_queue.empty() || m_closed; });
+        if(m_queue.empty())
+        {
+            return false;
+        }
+        v = m_queue.front();
+        m_queue.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_empty.notify_all();
+    }
+
+private:
+    size_t m_capacity;
+    std::deque<int> m_queue;
+    bool m_closed = false;
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+};
+
+static double elapsed_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 2个生产者、2个消费者，容量1024，每秒传递的消息数
+void bench(int messages)
+{
+    const int pairs = 2;
+    const int per_producer = messages / pairs;
+
+    //协程之间：生产者和消费者都是IOManager里的协程。
+    //计时到最后一个消费者结束为止，不包括IOManager的停止过程
+    {
+        Channel<int> ch(1024);
+        std::atomic<int> left = {pairs};
+        std::atomic<int> consumers_left = {pairs};
+        double secs = 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            IOManager iom(pairs * 2, true);
+            for(int p = 0; p < pairs; ++p)
+            {
+                iom.scheduleLock([&]()
+                {
+                    for(int i = 0; i < per_producer; ++i)
+                    {
+                        ch.send(i);
+                    }
+                    if(--left == 0)
+                    {
+                        ch.close();
+                    }
+                });
+                iom.scheduleLock([&]()
+                {
+                    int v;
+                    while(ch.recv(v));
+                    if(--consumers_left == 0)
+                    {
+                        secs = elapsed_since(start);
+                    }
+                });
+            }
+        }
+        std::cout << "Channel, fibers:      " << (long)(pairs * per_producer / secs) << " msg/s" << std::endl;
+    }
+
+    //普通线程之间使用Channel
+    {
+        Channel<int> ch(1024);
+        std::atomic<int> left = {pairs};
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for(int p = 0; p < pairs; ++p)
+        {
+            threads.emplace_back([&]()
+            {
+                for(int i = 0; i < per_producer; ++i)
+                {
+                    ch.send(i);
+                }
+                if(--left == 0)
+                {
+                    ch.close();
+                }
+            });
+            threads.emplace_back([&]()
+            {
+                int v;
+                while(ch.recv(v));
+            });
+        }
+        for(auto& t : threads)
+        {
+            t.join();
+        }
+        double secs = elapsed_since(start);
+        std::cout << "Channel, threads:     " << (long)(pairs * per_producer / secs) << " msg/s" << std::endl;
+    }
+
+    //对照组：mutex + condition_variable
+    {
+        LockedQueue q(1024);
+        std::atomic<int> left = {pairs};
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for(int p = 0; p < pairs; ++p)
+        {
+            threads.emplace_back([&]()
+            {
+                for(int i = 0; i < per_producer; ++i)
+                {
+                    q.send(i);
+                }
+                if(--left == 0)
+                {
+                    q.close();
+                }
+            });
+            threads.emplace_back([&]()
+            {
+                int v;
+                while(q.recv(v));
+            });
+        }
+        for(auto& t : threads)
+        {
+            t.join();
+        }
+        double secs = elapsed_since(start);
+        std::cout << "mutex+condvar queue:  " << (long)(pairs * per_producer / secs) << " msg/s" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    set_hook_enable(false);
+    test_try_ops();
+    test_close();
+    test_non_default();
+    test_fibers();
+    test_timeout_and_select();
+    bench(argc > 1 ? atoi(argv[1]) : 1000000);
+    return 0;
+}
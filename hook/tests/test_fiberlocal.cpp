@@ -0,0 +1,181 @@
+// FiberLocal<T>的行为测试，以及和thread_local的访问开销对比。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/test_fiberlocal.cpp $(ls *.cpp | grep -v '^test.cpp$') -o test_fiberlocal -ldl -lpthread
+// 运行: ./test_fiberlocal [访问次数=100000000]
+
+#include "fiberlocal.h"
+#include "ioscheduler.h"
+#include "hook.h"
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+            exit(1); \
+        } \
+    } while(0)
+
+static std::atomic<int> live_count = {0};
+
+//统计存活对象数，检查协程结束和reset()时对象被销毁
+struct Tracked
+{
+    Tracked() { ++live_count; }
+    Tracked(const Tracked& other) : trace_id(other.trace_id) { ++live_count; }
+    ~Tracked() { --live_count; }
+    std::string trace_id;
+};
+
+static FiberLocal<Tracked> s_tracked;
+static FiberLocal<int> s_counter;
+
+//每个协程各有一份，交替让出时互不影响；协程结束后对象被销毁
+void test_isolation()
+{
+    {
+        IOManager iom(2, true);
+        for(int i = 0; i < 8; ++i)
+        {
+            iom.scheduleLock([i]()
+            {
+                CHECK(!s_tracked.has());
+                s_tracked->trace_id = "req-" + std::to_string(i);
+                CHECK(s_tracked.has());
+                for(int k = 0; k < 100; ++k)
+                {
+                    ++*s_counter;
+                    Scheduler::getThis()->scheduleLock(Fiber::getThis());
+                    Fiber::getThis()->yield();
+                    CHECK(s_tracked->trace_id == "req-" + std::to_string(i));
+                }
+                CHECK(*s_counter == 100);
+            });
+        }
+    }
+    CHECK(live_count == 0);
+    std::cout << "isolation: ok" << std::endl;
+}
+
+//set()替换旧对象，reset()提前销毁
+void test_set_reset()
+{
+    {
+        IOManager iom(1, true);
+        iom.scheduleLock([]()
+        {
+            s_counter.set(5);
+            CHECK(*s_counter == 5);
+
+            s_tracked.get();
+            CHECK(live_count == 1);
+            s_tracked.set(Tracked());
+            CHECK(live_count == 1);
+            s_tracked.reset();
+            CHECK(!s_tracked.has());
+            CHECK(live_count == 0);
+        });
+    }
+    std::cout << "set/reset: ok" << std::endl;
+}
+
+static thread_local std::string t_trace_id;
+
+//协程迁移到另一个工作线程后，FiberLocal跟着协程走，thread_local则是新线程上的值
+void test_migration()
+{
+    std::atomic<bool> migrated = {false};
+    {
+        IOManager iom(3, true);
+        iom.scheduleLock([&migrated]()
+        {
+            int here = Thread::getThreadId();
+            s_tracked->trace_id = "abc";
+            t_trace_id = "abc";
+
+            //找到另一个工作线程：投递任务直到它在别的线程上执行。临时关闭hook，sleep_for阻塞当前线程，任务只能由其他线程取走
+            std::atomic<int> other = {0};
+            auto start = std::chrono::steady_clock::now();
+            while(other == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(2))
+            {
+                Scheduler::getThis()->scheduleLock([&other, here]()
+                {
+                    if(Thread::getThreadId() != here)
+                    {
+                        other = Thread::getThreadId();
+                    }
+                });
+                set_hook_enable(false);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                set_hook_enable(true);
+            }
+            CHECK(other != 0);
+
+            Scheduler::getThis()->scheduleLock(Fiber::getThis(), other);
+            Fiber::getThis()->yield();
+            CHECK(Thread::getThreadId() == other);
+            CHECK(s_tracked->trace_id == "abc");
+            CHECK(t_trace_id != "abc");
+            migrated = true;
+        });
+    }
+    CHECK(migrated);
+    CHECK(live_count == 0);
+    std::cout << "migration: ok" << std::endl;
+}
+
+static thread_local long t_value = 0;
+static FiberLocal<long> s_value;
+
+__attribute__((noinline)) static void touch_thread_local()
+{
+    ++t_value;
+}
+
+__attribute__((noinline)) static void touch_fiber_local()
+{
+    ++*s_value;
+}
+
+void bench(long loops)
+{
+    std::atomic<bool> done = {false};
+    IOManager iom(1, true);
+    iom.scheduleLock([loops, &done]()
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(long i = 0; i < loops; ++i)
+        {
+            touch_thread_local();
+        }
+        double tl_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / loops;
+
+        start = std::chrono::steady_clock::now();
+        for(long i = 0; i < loops; ++i)
+        {
+            touch_fiber_local();
+        }
+        double fl_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / loops;
+
+        CHECK(t_value == loops);
+        CHECK(*s_value == loops);
+        std::cout << "thread_local: " << tl_ns << " ns/access" << std::endl;
+        std::cout << "FiberLocal:   " << fl_ns << " ns/access" << std::endl;
+        done = true;
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    test_isolation();
+    test_set_reset();
+    test_migration();
+    bench(argc > 1 ? atol(argv[1]) : 100000000);
+    return 0;
+}
@@ -0,0 +1,338 @@
+// FiberMutex、FiberCondVar、FiberSemaphore、FiberRWLock的行为测试。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/test_fibersync.cpp $(ls *.cpp | grep -v '^test.cpp$') -o test_fibersync -ldl -lpthread
+// 运行: ./test_fibersync
+
+#include "fibersync.h"
+#include "taskgroup.h"
+#include "ioscheduler.h"
+#include "hook.h"
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+            exit(1); \
+        } \
+    } while(0)
+
+static long elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+//在调度器中运行fn并等待它结束
+template <class Fn>
+static void run_in_iomanager(int threads, Fn fn)
+{
+    std::atomic<bool> done = {false};
+    {
+        IOManager iom(threads, true);
+        iom.scheduleLock([&done, fn]()
+        {
+            fn();
+            done = true;
+        });
+    }
+    CHECK(done);
+}
+
+//多个工作线程上的协程竞争同一把锁，临界区中偶尔在hook的usleep上挂起，强制其他协程排队
+void test_mutex_contention()
+{
+    const int fibers = 16;
+    const int rounds = 2000;
+    FiberMutex mutex;
+    long counter = 0;       //只在锁内访问，不是原子变量
+    int inside = 0;
+    bool ok = true;
+    {
+        IOManager iom(4, true);
+        for(int f = 0; f < fibers; ++f)
+        {
+            iom.scheduleLock([&, f]()
+            {
+                for(int i = 0; i < rounds; ++i)
+                {
+                    std::lock_guard<FiberMutex> lock(mutex);
+                    if(++inside != 1)
+                    {
+                        ok = false;
+                    }
+                    ++counter;
+                    if(i % 200 == f)
+                    {
+                        usleep(100);
+                    }
+                    --inside;
+                }
+            });
+        }
+    }
+    CHECK(ok);
+    CHECK(counter == (long)fibers * rounds);
+    std::cout << "mutex contention: ok" << std::endl;
+}
+
+//排队的协程按到达顺序获得锁，解锁时锁直接转交给第一个等待者，解锁方随后的try_lock失败
+void test_mutex_handoff()
+{
+    std::vector<int> arrived;
+    std::vector<int> order;
+    bool handed_off = false;
+    //只有一个工作线程，记录到达顺序和lock()之间不会被其他协程插入
+    run_in_iomanager(2, [&arrived, &order, &handed_off]()
+    {
+        FiberMutex mutex;
+        WaitGroup wg;
+        mutex.lock();
+        wg.add(5);
+        for(int i = 0; i < 5; ++i)
+        {
+            Scheduler::getThis()->scheduleLock([&mutex, &arrived, &order, &wg, i]()
+            {
+                arrived.push_back(i);
+                mutex.lock();
+                order.push_back(i);
+                mutex.unlock();
+                wg.done();
+            });
+        }
+        usleep(20 * 1000);  //让5个协程都排上队
+        mutex.unlock();
+        handed_off = !mutex.try_lock();
+        wg.wait();
+    });
+    CHECK(handed_off);
+    CHECK(arrived.size() == 5);
+    CHECK(order == arrived);
+    std::cout << "mutex handoff: ok" << std::endl;
+}
+
+void test_condvar()
+{
+    run_in_iomanager(3, []()
+    {
+        FiberMutex mutex;
+        FiberCondVar cond;
+        int tokens = 0;
+        std::atomic<int> woken = {0};
+        WaitGroup wg;
+        wg.add(4);
+        for(int i = 0; i < 4; ++i)
+        {
+            Scheduler::getThis()->scheduleLock([&]()
+            {
+                std::unique_lock<FiberMutex> lock(mutex);
+                cond.wait(lock, [&tokens]() { return tokens > 0; });
+                --tokens;
+                ++woken;
+                lock.unlock();
+                wg.done();
+            });
+        }
+        usleep(20 * 1000);
+
+        //notify_one只唤醒一个
+        {
+            std::lock_guard<FiberMutex> lock(mutex);
+            tokens = 1;
+        }
+        cond.notify_one();
+        usleep(20 * 1000);
+        CHECK(woken == 1);
+
+        //notify_all唤醒其余全部
+        {
+            std::lock_guard<FiberMutex> lock(mutex);
+            tokens = 3;
+        }
+        cond.notify_all();
+        wg.wait();
+        CHECK(woken == 4);
+        CHECK(tokens == 0);
+
+        //没有通知时超时返回false
+        std::unique_lock<FiberMutex> lock(mutex);
+        auto start = std::chrono::steady_clock::now();
+        CHECK(!cond.wait_for(lock, 30));
+        CHECK(elapsed_ms(start) >= 30);
+        CHECK(lock.owns_lock());
+
+        //超时之前被通知返回true
+        bool flag = false;
+        wg.add(1);
+        Scheduler::getThis()->scheduleLock([&]()
+        {
+            usleep(10 * 1000);
+            {
+                std::lock_guard<FiberMutex> guard(mutex);
+                flag = true;
+            }
+            cond.notify_one();
+            wg.done();
+        });
+        start = std::chrono::steady_clock::now();
+        CHECK(cond.wait_for(lock, 1000, [&flag]() { return flag; }));
+        CHECK(elapsed_ms(start) < 500);
+        lock.unlock();
+        wg.wait();
+
+        //超时的等待者不会吞掉之后的通知
+        std::atomic<bool> late_woken = {false};
+        wg.add(1);
+        Scheduler::getThis()->scheduleLock([&]()
+        {
+            std::unique_lock<FiberMutex> guard(mutex);
+            late_woken = cond.wait_for(guard, 1000);
+            wg.done();
+        });
+        lock.lock();
+        CHECK(!cond.wait_for(lock, 5));
+        lock.unlock();
+        usleep(20 * 1000);
+        cond.notify_one();
+        wg.wait();
+        CHECK(late_woken);
+    });
+    std::cout << "condvar: ok" << std::endl;
+}
+
+void test_semaphore()
+{
+    FiberSemaphore counting(2);
+    CHECK(counting.tryWait());
+    CHECK(counting.tryWait());
+    CHECK(!counting.tryWait());
+    counting.signal();
+    CHECK(counting.tryWait());
+
+    //计数为3：同时进入的协程不超过3个，并且确实有3个同时进入
+    std::atomic<int> max_inside = {0};
+    run_in_iomanager(3, [&max_inside]()
+    {
+        FiberSemaphore sem(3);
+        std::atomic<int> inside = {0};
+        WaitGroup wg;
+        wg.add(10);
+        for(int i = 0; i < 10; ++i)
+        {
+            Scheduler::getThis()->scheduleLock([&]()
+            {
+                sem.wait();
+                int now = ++inside;
+                int prev = max_inside;
+                while(now > prev && !max_inside.compare_exchange_weak(prev, now));
+                usleep(10 * 1000);
+                --inside;
+                sem.signal();
+                wg.done();
+            });
+        }
+        wg.wait();
+        CHECK(sem.tryWait() && sem.tryWait() && sem.tryWait());
+        CHECK(!sem.tryWait());
+    });
+    CHECK(max_inside == 3);
+    std::cout << "semaphore: ok" << std::endl;
+}
+
+void test_rwlock()
+{
+    run_in_iomanager(3, []()
+    {
+        FiberRWLock rwlock;
+        std::vector<std::string> order;
+        FiberMutex order_mutex;
+        auto record = [&order, &order_mutex](const char* name)
+        {
+            std::lock_guard<FiberMutex> lock(order_mutex);
+            order.push_back(name);
+        };
+
+        //读者R1持有读锁时写者W排队，之后到达的读者R2不能越过W
+        WaitGroup wg;
+        wg.add(3);
+        Scheduler::getThis()->scheduleLock([&]()
+        {
+            rwlock.lock_shared();
+            record("R1");
+            usleep(30 * 1000);
+            rwlock.unlock_shared();
+            wg.done();
+        });
+        usleep(5 * 1000);
+        Scheduler::getThis()->scheduleLock([&]()
+        {
+            rwlock.lock();
+            record("W");
+            usleep(10 * 1000);
+            rwlock.unlock();
+            wg.done();
+        });
+        usleep(5 * 1000);
+        Scheduler::getThis()->scheduleLock([&]()
+        {
+            rwlock.lock_shared();
+            record("R2");
+            rwlock.unlock_shared();
+            wg.done();
+        });
+        wg.wait();
+        CHECK((order == std::vector<std::string>{"R1", "W", "R2"}));
+
+        //读者源源不断时写者仍然能拿到锁，写者持有期间没有读者
+        std::atomic<bool> stop = {false};
+        std::atomic<int> readers = {0};
+        bool overlap = false;
+        wg.add(4);
+        for(int i = 0; i < 4; ++i)
+        {
+            Scheduler::getThis()->scheduleLock([&]()
+            {
+                while(!stop)
+                {
+                    rwlock.lock_shared();
+                    ++readers;
+                    usleep(1000);
+                    --readers;
+                    rwlock.unlock_shared();
+                }
+                wg.done();
+            });
+        }
+        usleep(10 * 1000);
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < 5; ++i)
+        {
+            rwlock.lock();
+            if(readers != 0)
+            {
+                overlap = true;
+            }
+            rwlock.unlock();
+        }
+        long writer_ms = elapsed_ms(start);
+        stop = true;
+        wg.wait();
+        CHECK(!overlap);
+        CHECK(writer_ms < 200);
+    });
+    std::cout << "rwlock: ok" << std::endl;
+}
+
+int main()
+{
+    test_mutex_contention();
+    test_mutex_handoff();
+    test_condvar();
+    test_semaphore();
+    test_rwlock();
+    return 0;
+}
@@ -0,0 +1,218 @@
+// Future/Promise、Scheduler::spawn、whenAll/whenAny的行为测试。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/test_future.cpp $(ls *.cpp | grep -v '^test.cpp$') -o test_future -ldl -lpthread
+
+#include "future.h"
+#include "ioscheduler.h"
+#include "hook.h"
+
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <chrono>
+#include <cstdlib>
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+            exit(1); \
+        } \
+    } while(0)
+
+//IOManager的工作线程开启了hook，usleep挂起协程而不阻塞线程
+static void fiber_sleep_ms(int ms)
+{
+    usleep(ms * 1000);
+}
+
+void test_spawn_get()
+{
+    std::atomic<bool> done = {false};
+    {
+        IOManager iom(2, true);
+        iom.scheduleLock([&done]()
+        {
+            Scheduler* scheduler = Scheduler::getThis();
+
+            //有返回值
+            Future<int> f1 = scheduler->spawn([]()
+            {
+                fiber_sleep_ms(10);
+                return 42;
+            });
+            CHECK(f1.valid());
+            CHECK(f1.get() == 42);
+            CHECK(!f1.valid());
+
+            //无返回值
+            std::atomic<int> counter = {0};
+            Future<void> f2 = scheduler->spawn([&counter]()
+            {
+                ++counter;
+            });
+            f2.get();
+            CHECK(counter == 1);
+
+            //异常在get()中重新抛出
+            Future<int> f3 = scheduler->spawn([]() -> int
+            {
+                throw std::runtime_error("boom");
+            });
+            bool caught = false;
+            try
+            {
+                f3.get();
+            }
+            catch(const std::runtime_error& e)
+            {
+                caught = std::string(e.what()) == "boom";
+            }
+            CHECK(caught);
+
+            //只能移动的可调用对象
+            std::unique_ptr<int> p(new int(7));
+            Future<int> f4 = scheduler->spawn([p = std::move(p)]()
+            {
+                return *p * 2;
+            });
+            CHECK(f4.get() == 14);
+            done = true;
+        });
+    }
+    CHECK(done);
+    std::cout << "spawn/get: ok" << std::endl;
+}
+
+void test_promise()
+{
+    std::atomic<bool> done = {false};
+    {
+        IOManager iom(2, true);
+        std::shared_ptr<Promise<std::string>> promise = std::make_shared<Promise<std::string>>();
+        Future<std::string> future = promise->getFuture();
+
+        //协程等待另一个协程设置结果
+        iom.scheduleLock([&done, &future]()
+        {
+            CHECK(future.get() == "hello");
+            done = true;
+        });
+        iom.scheduleLock([promise]()
+        {
+            fiber_sleep_ms(20);
+            promise->setValue("hello");
+        });
+    }
+    CHECK(done);
+
+    //移动赋值覆盖一个还没有设置结果的Promise，原来的Future得到broken_promise
+    Promise<int> first;
+    Future<int> abandoned = first.getFuture();
+    Promise<int> second;
+    Future<int> kept = second.getFuture();
+    first = std::move(second);
+    CHECK(abandoned.isReady());
+    bool broken = false;
+    try
+    {
+        abandoned.get();
+    }
+    catch(const std::future_error& e)
+    {
+        broken = e.code() == std::future_errc::broken_promise;
+    }
+    CHECK(broken);
+    CHECK(!kept.isReady());
+    first.setValue(7);
+    CHECK(kept.get() == 7);
+    std::cout << "promise: ok" << std::endl;
+}
+
+void test_when_all_any()
+{
+    std::atomic<bool> done = {false};
+    {
+        IOManager iom(2, true);
+        iom.scheduleLock([&done]()
+        {
+            Scheduler* scheduler = Scheduler::getThis();
+
+            //hook的usleep挂起协程，10个任务并发等待，总时间接近最长的一个(55ms)，串行执行需要325ms
+            auto start = std::chrono::steady_clock::now();
+            std::vector<Future<int>> futures;
+            for(int i = 0; i < 10; ++i)
+            {
+                futures.push_back(scheduler->spawn([i]()
+                {
+                    fiber_sleep_ms(10 + i * 5);
+                    return i;
+                }));
+            }
+            whenAll(futures).get();
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            CHECK(elapsed >= 55);
+            CHECK(elapsed < 200);
+            for(int i = 0; i < 10; ++i)
+            {
+                CHECK(futures[i].isReady());
+                CHECK(futures[i].get() == i);
+            }
+
+            //空集合立即就绪
+            std::vector<Future<int>> empty;
+            CHECK(whenAll(empty).isReady());
+
+            //whenAny返回最先完成的下标
+            std::vector<Future<int>> race;
+            race.push_back(scheduler->spawn([]() { fiber_sleep_ms(200); return 0; }));
+            race.push_back(scheduler->spawn([]() { fiber_sleep_ms(10); return 1; }));
+            race.push_back(scheduler->spawn([]() { fiber_sleep_ms(100); return 2; }));
+            CHECK(whenAny(race).get() == 1);
+            whenAll(race).get();
+
+            //同一个future上登记多个组合器，丢弃的组合器结果不影响其他的
+            Promise<int> promise;
+            std::vector<Future<int>> shared;
+            shared.push_back(promise.getFuture());
+            std::vector<Future<size_t>> anys;
+            for(int i = 0; i < 100; ++i)
+            {
+                anys.push_back(whenAny(shared));
+                whenAll(shared);
+            }
+            promise.setValue(3);
+            for(auto& any : anys)
+            {
+                CHECK(any.isReady());
+                CHECK(any.get() == 0);
+            }
+            done = true;
+        });
+    }
+    CHECK(done);
+    std::cout << "whenAll/whenAny: ok" << std::endl;
+}
+
+//普通线程(这里是主线程，还没有进入调度)等待协程的结果，用信号量阻塞
+void test_get_from_thread()
+{
+    IOManager iom(2, true);
+    Future<int> future = iom.spawn([]()
+    {
+        fiber_sleep_ms(10);
+        return 5;
+    });
+    CHECK(future.get() == 5);
+    std::cout << "get from thread: ok" << std::endl;
+}
+
+int main()
+{
+    test_spawn_get();
+    test_promise();
+    test_when_all_any();
+    test_get_from_thread();
+    return 0;
+}
@@ -0,0 +1,247 @@
+// parallel_for/parallel_reduce/parallel_invoke/parallel_sort的正确性测试，以及归约的吞吐量对比(串行、本库、TBB)。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/test_parallel.cpp $(ls *.cpp | grep -v '^test.cpp$') -o test_parallel -ldl -lpthread
+// 和TBB对比时加上 -DWITH_TBB -ltbb
+// 运行: ./test_parallel [归约元素数=50000000] [线程数=CPU数，至少2]
+
+#include "parallel.h"
+#include "future.h"
+#include "ioscheduler.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#ifdef WITH_TBB
+#include <oneapi/tbb/parallel_reduce.h>
+#include <oneapi/tbb/blocked_range.h>
+#include <oneapi/tbb/global_control.h>
+#endif
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+            exit(1); \
+        } \
+    } while(0)
+
+void test_for()
+{
+    std::vector<long> v(100000, 0);
+    parallel_for(0, (int)v.size(), [&v](int i)
+    {
+        v[i] = (long)i * 2;
+    });
+    for(size_t i = 0; i < v.size(); ++i)
+    {
+        CHECK(v[i] == (long)i * 2);
+    }
+
+    //空区间和只有一个元素的区间
+    parallel_for(5, 5, [](int) { CHECK(false); });
+    int touched = 0;
+    parallel_for(0, 1, [&touched](int) { ++touched; });
+    CHECK(touched == 1);
+    std::cout << "parallel_for: ok" << std::endl;
+}
+
+void test_reduce()
+{
+    const long n = 1000000;
+    long sum = parallel_reduce(0L, n, 0L, [](long first, long last, long acc)
+    {
+        for(long i = first; i < last; ++i)
+        {
+            acc += i;
+        }
+        return acc;
+    }, std::plus<long>());
+    CHECK(sum == n * (n - 1) / 2);
+
+    //combine只满足结合律：字符串拼接的结果必须按下标顺序
+    std::string digits = parallel_reduce(0, 1000, std::string(), [](int first, int last, std::string acc)
+    {
+        for(int i = first; i < last; ++i)
+        {
+            acc += (char)('0' + i % 10);
+        }
+        return acc;
+    }, [](const std::string& a, const std::string& b) { return a + b; }, 7);
+    CHECK(digits.size() == 1000);
+    for(int i = 0; i < 1000; ++i)
+    {
+        CHECK(digits[i] == (char)('0' + i % 10));
+    }
+    std::cout << "parallel_reduce: ok" << std::endl;
+}
+
+void test_invoke()
+{
+    std::atomic<int> mask = {0};
+    parallel_invoke([&mask]() { mask |= 1; }, [&mask]() { mask |= 2; }, [&mask]() { mask |= 4; });
+    CHECK(mask == 7);
+    std::cout << "parallel_invoke: ok" << std::endl;
+}
+
+void test_sort()
+{
+    std::mt19937 rng(12345);
+    for(size_t n : {0, 1, 100, 4097, 100000, 1000003})
+    {
+        std::vector<int> v(n);
+        for(auto& x : v)
+        {
+            x = (int)(rng() % 1000);    //大量重复值
+        }
+        std::vector<int> expected = v;
+        std::sort(expected.begin(), expected.end());
+        parallel_sort(v.begin(), v.end());
+        CHECK(v == expected);
+    }
+
+    std::vector<int> v(200000);
+    std::iota(v.begin(), v.end(), 0);
+    std::shuffle(v.begin(), v.end(), rng);
+    parallel_sort(v.begin(), v.end(), std::greater<int>());
+    CHECK(std::is_sorted(v.begin(), v.end(), std::greater<int>()));
+    std::cout << "parallel_sort: ok" << std::endl;
+}
+
+void test_exception()
+{
+    std::atomic<int> ran = {0};
+    bool caught = false;
+    try
+    {
+        parallel_for(0, 10000, [&ran](int i)
+        {
+            ++ran;
+            if(i == 500)
+            {
+                throw std::runtime_error("bad element");
+            }
+        }, 100);
+    }
+    catch(const std::runtime_error& e)
+    {
+        caught = std::string(e.what()) == "bad element";
+    }
+    CHECK(caught);
+    CHECK(ran <= 10000);
+    std::cout << "exception: ok" << std::endl;
+}
+
+//在工作线程的协程中嵌套调用，所有线程都在等待时也不会死锁
+void test_nested(IOManager& iom)
+{
+    Future<long> future = iom.spawn([]()
+    {
+        std::vector<long> rows(64, 0);
+        parallel_for(0, 64, [&rows](int r)
+        {
+            rows[r] = parallel_reduce(0, 1000, 0L, [](int first, int last, long acc)
+            {
+                for(int i = first; i < last; ++i)
+                {
+                    acc += i;
+                }
+                return acc;
+            }, std::plus<long>(), 10);
+        }, 1);
+        return std::accumulate(rows.begin(), rows.end(), 0L);
+    });
+    CHECK(future.get() == 64L * 999 * 1000 / 2);
+    std::cout << "nested: ok" << std::endl;
+}
+
+static double work(long i)
+{
+    return std::sqrt((double)i) * 1.0000001;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// sum(work(i))，每种实现取3次中最快的一次
+void bench(long n, int threads)
+{
+    auto range_sum = [](long first, long last, double acc)
+    {
+        for(long i = first; i < last; ++i)
+        {
+            acc += work(i);
+        }
+        return acc;
+    };
+
+    double serial_best = 1e9;
+    double serial_value = 0;
+    for(int r = 0; r < 3; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        serial_value = range_sum(0, n, 0.0);
+        serial_best = std::min(serial_best, seconds_since(start));
+    }
+
+    double ours_best = 1e9;
+    for(int r = 0; r < 3; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        double value = parallel_reduce(0L, n, 0.0, range_sum, std::plus<double>());
+        ours_best = std::min(ours_best, seconds_since(start));
+        CHECK(std::fabs(value - serial_value) <= 1e-9 * std::fabs(serial_value));
+    }
+
+    std::cout << "reduce " << n << " elements, " << threads << " threads (TBB limited to the same):" << std::endl;
+    std::cout << "  serial:          " << (long)(n / serial_best / 1e6) << " M elements/s" << std::endl;
+    std::cout << "  parallel_reduce: " << (long)(n / ours_best / 1e6) << " M elements/s" << std::endl;
+
+#ifdef WITH_TBB
+    oneapi::tbb::global_control limit(oneapi::tbb::global_control::max_allowed_parallelism, threads);
+    double tbb_best = 1e9;
+    for(int r = 0; r < 3; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        double value = oneapi::tbb::parallel_reduce(oneapi::tbb::blocked_range<long>(0, n), 0.0,
+            [&range_sum](const oneapi::tbb::blocked_range<long>& range, double acc)
+            {
+                return range_sum(range.begin(), range.end(), acc);
+            }, std::plus<double>());
+        tbb_best = std::min(tbb_best, seconds_since(start));
+        CHECK(std::fabs(value - serial_value) <= 1e-9 * std::fabs(serial_value));
+    }
+    std::cout << "  tbb:             " << (long)(n / tbb_best / 1e6) << " M elements/s" << std::endl;
+    std::cout << "  parallel_reduce / tbb = " << (int)(100 * tbb_best / ours_best) << "%" << std::endl;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    long n = argc > 1 ? atol(argv[1]) : 50000000;
+    int threads = argc > 2 ? atoi(argv[2]) : (int)std::max(1u, std::thread::hardware_concurrency());
+    //至少要有一个工作线程：test_nested中主线程阻塞在get()上，spawn的任务只能由工作线程执行
+    threads = std::max(threads, 2);
+
+    //主线程是use_caller的调用者，parallel_*在主线程中调用时也领取分块，参与计算的一共threads个线程
+    IOManager iom(threads, true);
+    test_for();
+    test_reduce();
+    test_invoke();
+    test_sort();
+    test_exception();
+    test_nested(iom);
+    bench(n, threads);
+    return 0;
+}
@@ -0,0 +1,182 @@
+// Scheduler任务优先级、防饿死和QueueStats的行为测试。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/test_priority.cpp $(ls *.cpp | grep -v '^test.cpp$') -o test_priority -ldl -lpthread
+// 运行: ./test_priority
+
+#include "ioscheduler.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <unistd.h>
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+            exit(1); \
+        } \
+    } while(0)
+
+static uint64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//不让出协程地占用工作线程us微秒
+static void spin_us(uint64_t us)
+{
+    uint64_t end = now_us() + us;
+    while(now_us() < end);
+}
+
+//主线程(还没有进入调度，没有开启hook)等待条件成立
+template <class Pred>
+static void wait_until(Pred pred)
+{
+    while(!pred())
+    {
+        usleep(1000);
+    }
+}
+
+//IOManager(2, true)只有一个工作线程，调用者线程在析构之前不取任务，执行顺序就是出队顺序。
+//门任务占住工作线程，期间主线程投递的任务都在队列中排队
+void test_priority_order()
+{
+    std::vector<std::string> order;     //只在唯一的工作线程上访问
+    std::atomic<int> finished = {0};
+    std::atomic<bool> gate_started = {false};
+    std::atomic<bool> gate_open = {false};
+    IOManager iom(2, true);
+    iom.setStarvationLimit(10 * 1000);
+
+    iom.scheduleLock([&]()
+    {
+        gate_started = true;
+        while(!gate_open)
+        {
+            std::this_thread::yield();
+        }
+    });
+    wait_until([&]() { return gate_started.load(); });
+
+    uint64_t posted_us = now_us();
+    for(int i = 0; i < 5; ++i)
+    {
+        iom.scheduleLock([&order, &finished, i]()
+        {
+            order.push_back("L" + std::to_string(i));
+            ++finished;
+        }, -1, Scheduler::PRIORITY_LOW);
+    }
+    for(int i = 0; i < 5; ++i)
+    {
+        iom.scheduleLock([&order, &finished, i]()
+        {
+            order.push_back("H" + std::to_string(i));
+            ++finished;
+        }, -1, Scheduler::PRIORITY_HIGH);
+    }
+
+    //排队长度
+    CHECK(iom.getQueueStats(Scheduler::PRIORITY_HIGH).queued == 5);
+    CHECK(iom.getQueueStats(Scheduler::PRIORITY_NORMAL).queued == 0);
+    CHECK(iom.getQueueStats(Scheduler::PRIORITY_LOW).queued == 5);
+
+    usleep(20 * 1000);
+    gate_open = true;
+    wait_until([&]() { return finished == 10; });
+    uint64_t waited_us = now_us() - posted_us;
+
+    //后投递的HIGH全部排在先投递的LOW前面，同一优先级内先进先出
+    CHECK((order == std::vector<std::string>{"H0", "H1", "H2", "H3", "H4", "L0", "L1", "L2", "L3", "L4"}));
+
+    //出队计数、排队延迟和排队长度
+    Scheduler::QueueStats high = iom.getQueueStats(Scheduler::PRIORITY_HIGH);
+    Scheduler::QueueStats normal = iom.getQueueStats(Scheduler::PRIORITY_NORMAL);
+    Scheduler::QueueStats low = iom.getQueueStats(Scheduler::PRIORITY_LOW);
+    CHECK(high.tasks == 5);
+    CHECK(normal.tasks == 1);
+    CHECK(low.tasks == 5);
+    CHECK(high.queued == 0 && normal.queued == 0 && low.queued == 0);
+    CHECK(low.max_delay_us >= 20 * 1000);
+    CHECK(low.max_delay_us <= waited_us);
+    CHECK(high.max_delay_us <= low.max_delay_us);
+    CHECK(low.total_delay_us >= 5 * 20 * 1000);
+    CHECK(low.total_delay_us <= 5 * low.max_delay_us);
+    std::cout << "priority order: ok" << std::endl;
+}
+
+//HIGH队列一直不空时，LOW任务排队超过上限后仍然被执行
+void test_starvation_limit()
+{
+    const uint64_t limit_ms = 20;
+    std::atomic<bool> low_ran = {false};
+    std::atomic<uint64_t> low_run_us = {0};
+    std::atomic<size_t> high_queued_at_low = {0};
+    std::atomic<int> high_ran = {0};
+    IOManager iom(2, true);
+    iom.setStarvationLimit(limit_ms);
+
+    auto post_high = [&iom, &high_ran]()
+    {
+        iom.scheduleLock([&high_ran]()
+        {
+            spin_us(500);
+            ++high_ran;
+        }, -1, Scheduler::PRIORITY_HIGH);
+    };
+
+    //先让HIGH负载跑起来，队列中保持十几个HIGH任务
+    for(int i = 0; i < 16; ++i)
+    {
+        post_high();
+    }
+    wait_until([&]() { return high_ran > 0; });
+
+    uint64_t posted_us = now_us();
+    iom.scheduleLock([&]()
+    {
+        low_run_us = now_us();
+        high_queued_at_low = iom.getQueueStats(Scheduler::PRIORITY_HIGH).queued;
+        low_ran = true;
+    }, -1, Scheduler::PRIORITY_LOW);
+
+    //持续补充HIGH任务，最多2秒：没有防饿死的话LOW在这期间不会执行
+    uint64_t deadline = posted_us + 2000 * 1000;
+    while(!low_ran && now_us() < deadline)
+    {
+        while(iom.getQueueStats(Scheduler::PRIORITY_HIGH).queued < 16)
+        {
+            post_high();
+        }
+        usleep(200);
+    }
+    CHECK(low_ran);
+    uint64_t delay_us = low_run_us - posted_us;
+
+    //LOW越过了仍在排队的HIGH，等待时间不少于上限，也不会比上限晚太多
+    CHECK(high_queued_at_low > 0);
+    CHECK(delay_us >= limit_ms * 1000);
+    CHECK(delay_us < limit_ms * 1000 + 200 * 1000);
+
+    Scheduler::QueueStats low = iom.getQueueStats(Scheduler::PRIORITY_LOW);
+    CHECK(low.tasks == 1);
+    CHECK(low.queued == 0);
+    CHECK(low.max_delay_us >= limit_ms * 1000);
+    CHECK(low.max_delay_us == low.total_delay_us);
+    wait_until([&]() { return iom.getQueueStats(Scheduler::PRIORITY_HIGH).queued == 0; });
+    std::cout << "starvation limit: ok" << std::endl;
+}
+
+int main()
+{
+    test_priority_order();
+    test_starvation_limit();
+    return 0;
+}
@@ -0,0 +1,247 @@
+// Strand和StrandPool的顺序测试，以及和"每个会话一把互斥锁"的吞吐量对比。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/test_strand.cpp $(ls *.cpp | grep -v '^test.cpp$') -o test_strand -ldl -lpthread
+// 运行: ./test_strand [任务数=1000000]
+
+#include "strand.h"
+#include "taskgroup.h"
+#include "ioscheduler.h"
+#include "hook.h"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdlib>
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+            exit(1); \
+        } \
+    } while(0)
+
+static long elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+//多个普通线程同时投递：同一个Strand的任务不会并发执行，每个生产者的任务按投递顺序执行
+void test_order_and_exclusion()
+{
+    const int producers = 4;
+    const int per_producer = 20000;
+    std::vector<int> last(producers, -1);   //只在Strand中访问，不加锁
+    std::atomic<int> running = {0};
+    std::atomic<int> executed = {0};
+    bool ok = true;
+    {
+        IOManager iom(3, true);
+        std::shared_ptr<Strand> strand = std::make_shared<Strand>(&iom);
+        std::vector<std::thread> threads;
+        for(int p = 0; p < producers; ++p)
+        {
+            threads.emplace_back([&, p]()
+            {
+                for(int i = 0; i < per_producer; ++i)
+                {
+                    strand->post([&, p, i]()
+                    {
+                        if(running.fetch_add(1) != 0 || last[p] != i - 1)
+                        {
+                            ok = false;
+                        }
+                        last[p] = i;
+                        running.fetch_sub(1);
+                        ++executed;
+                    });
+                }
+            });
+        }
+        for(auto& t : threads)
+        {
+            t.join();
+        }
+    }
+    CHECK(ok);
+    CHECK(executed == producers * per_producer);
+    std::cout << "order/exclusion: ok" << std::endl;
+}
+
+//任务在hook的sleep上挂起时，后续任务等它结束；不同Strand之间并行
+void test_suspend_and_parallel()
+{
+    std::vector<int> order;
+    long serial_ms = 0;
+    long parallel_ms = 0;
+    {
+        IOManager iom(2, true);
+        iom.scheduleLock([&]()
+        {
+            std::shared_ptr<Strand> a = std::make_shared<Strand>();
+            WaitGroup wg;
+            wg.add(3);
+            auto start = std::chrono::steady_clock::now();
+            for(int i = 0; i < 3; ++i)
+            {
+                a->post([&order, &wg, i]()
+                {
+                    usleep((30 - i * 10) * 1000);   //先投递的睡得更久
+                    order.push_back(i);
+                    wg.done();
+                });
+            }
+            wg.wait();
+            serial_ms = elapsed_ms(start);
+
+            //两个Strand各一个50ms的任务
+            std::shared_ptr<Strand> b = std::make_shared<Strand>();
+            std::shared_ptr<Strand> c = std::make_shared<Strand>();
+            wg.add(2);
+            start = std::chrono::steady_clock::now();
+            for(auto& s : {b, c})
+            {
+                s->post([&wg]()
+                {
+                    usleep(50 * 1000);
+                    wg.done();
+                });
+            }
+            wg.wait();
+            parallel_ms = elapsed_ms(start);
+        });
+    }
+    CHECK((order == std::vector<int>{0, 1, 2}));
+    CHECK(serial_ms >= 60);
+    CHECK(parallel_ms >= 50 && parallel_ms < 95);
+    std::cout << "suspend/parallel: ok" << std::endl;
+}
+
+//在Strand中dispatch直接执行，在Strand外dispatch等同于post
+void test_dispatch()
+{
+    std::vector<int> order;
+    {
+        IOManager iom(2, true);
+        std::shared_ptr<Strand> strand = std::make_shared<Strand>(&iom);
+        strand->post([&order, strand]()
+        {
+            CHECK(strand->runningInThisStrand());
+            order.push_back(1);
+            strand->dispatch([&order]() { order.push_back(2); });
+            strand->post([&order]() { order.push_back(4); });
+            order.push_back(3);
+        });
+    }
+    CHECK((order == std::vector<int>{1, 2, 3, 4}));
+    std::cout << "dispatch: ok" << std::endl;
+}
+
+//StrandPool：同一个key的任务按顺序执行
+void test_pool()
+{
+    const int keys = 100;
+    const int per_key = 1000;
+    std::vector<int> last(keys, -1);
+    bool ok = true;
+    {
+        IOManager iom(3, true);
+        StrandPool<int> pool(16, &iom);
+        for(int i = 0; i < per_key; ++i)
+        {
+            for(int k = 0; k < keys; ++k)
+            {
+                pool.post(k, [&last, &ok, k, i]()
+                {
+                    if(last[k] != i - 1)
+                    {
+                        ok = false;
+                    }
+                    last[k] = i;
+                });
+            }
+        }
+    }
+    CHECK(ok);
+    for(int k = 0; k < keys; ++k)
+    {
+        CHECK(last[k] == per_key - 1);
+    }
+    std::cout << "StrandPool: ok" << std::endl;
+}
+
+// 64个会话，每个任务给一个会话的计数器加一：
+// StrandPool不加锁，对照组是每个会话一把std::mutex、任务直接交给调度器
+void bench(int tasks)
+{
+    const int sessions = 64;
+    {
+        std::vector<long> counters(sessions, 0);
+        auto start = std::chrono::steady_clock::now();
+        {
+            IOManager iom(3, true);
+            StrandPool<int> pool(sessions, &iom);
+            for(int i = 0; i < tasks; ++i)
+            {
+                int s = i % sessions;
+                pool.post(s, [&counters, s]() { ++counters[s]; });
+            }
+        }
+        double secs = elapsed_ms(start) / 1000.0;
+        long total = 0;
+        for(long c : counters)
+        {
+            total += c;
+        }
+        CHECK(total == tasks);
+        std::cout << "StrandPool:            " << (long)(tasks / secs) << " tasks/s" << std::endl;
+    }
+    //对照组的任务分别以协程(scheduleLock)和不创建协程的回调(scheduleInline)执行
+    for(int inline_cb = 0; inline_cb < 2; ++inline_cb)
+    {
+        std::vector<long> counters(sessions, 0);
+        std::vector<std::mutex> mutexes(sessions);
+        auto start = std::chrono::steady_clock::now();
+        {
+            IOManager iom(3, true);
+            for(int i = 0; i < tasks; ++i)
+            {
+                int s = i % sessions;
+                auto fn = [&counters, &mutexes, s]()
+                {
+                    std::lock_guard<std::mutex> lock(mutexes[s]);
+                    ++counters[s];
+                };
+                if(inline_cb)
+                {
+                    iom.scheduleInline(fn);
+                }
+                else
+                {
+                    iom.scheduleLock(fn);
+                }
+            }
+        }
+        double secs = elapsed_ms(start) / 1000.0;
+        long total = 0;
+        for(long c : counters)
+        {
+            total += c;
+        }
+        CHECK(total == tasks);
+        std::cout << (inline_cb ? "mutex, scheduleInline: " : "mutex, scheduleLock:   ") << (long)(tasks / secs) << " tasks/s" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    test_order_and_exclusion();
+    test_suspend_and_parallel();
+    test_dispatch();
+    test_pool();
+    bench(argc > 1 ? atoi(argv[1]) : 1000000);
+    return 0;
+}
@@ -0,0 +1,344 @@
+// C++20 Task<T>协程的行为测试，以及挂起的协程和挂起的Fiber的内存占用对比。
+// 需要以C++20编译(在hook/目录下):
+// g++ -std=c++20 -O2 -I. tests/test_task.cpp $(ls *.cpp | grep -v '^test.cpp$') -o test_task -ldl -lpthread
+
+#include "task.h"
+#include "channel.h"
+#include "taskgroup.h"
+#include "fiberlocal.h"
+#include "cancellation.h"
+#include "deadline.h"
+#include "ioscheduler.h"
+#include "hook.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <chrono>
+#include <cstdlib>
+#include <malloc.h>
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+            exit(1); \
+        } \
+    } while(0)
+
+static long elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+Task<int> add(int a, int b)
+{
+    co_return a + b;
+}
+
+//嵌套co_await，结果逐层返回
+Task<int> sum_to(int n)
+{
+    int sum = 0;
+    for(int i = 1; i <= n; ++i)
+    {
+        sum = co_await add(sum, i);
+    }
+    co_return sum;
+}
+
+Task<int> fail()
+{
+    co_await sleepFor(1);
+    throw std::runtime_error("task failed");
+}
+
+Task<void> catch_inner(std::atomic<bool>& caught)
+{
+    try
+    {
+        co_await fail();
+    }
+    catch(const std::runtime_error&)
+    {
+        caught = true;
+    }
+}
+
+void test_results_and_exceptions()
+{
+    IOManager iom(2, true);
+    CHECK(coSpawn(sum_to(100), &iom).get() == 5050);
+
+    //异常从被等待的协程传到等待者，也能传到Future
+    std::atomic<bool> caught = {false};
+    coSpawn(catch_inner(caught), &iom).get();
+    CHECK(caught);
+
+    Future<int> future = coSpawn(fail(), &iom);
+    bool thrown = false;
+    try
+    {
+        future.get();
+    }
+    catch(const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+    std::cout << "results/exceptions: ok" << std::endl;
+}
+
+Task<void> sleeper(std::atomic<int>& finished)
+{
+    co_await sleepFor(50);
+    ++finished;
+}
+
+//1000个协程同时睡眠，总时间接近一次睡眠
+void test_sleep()
+{
+    IOManager iom(2, true);
+    std::atomic<int> finished = {0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Future<void>> futures;
+    for(int i = 0; i < 1000; ++i)
+    {
+        futures.push_back(coSpawn(sleeper(finished), &iom));
+    }
+    for(auto& future : futures)
+    {
+        future.get();
+    }
+    long ms = elapsed_ms(start);
+    CHECK(finished == 1000);
+    CHECK(ms >= 50 && ms < 1000);
+    std::cout << "sleepFor: ok" << std::endl;
+}
+
+Task<int> read_one(int fd)
+{
+    int rt = co_await waitEvent(fd, IOManager::READ);
+    if(rt != 0)
+    {
+        co_return -1;
+    }
+    char c = 0;
+    CHECK(read(fd, &c, 1) == 1);
+    co_return c;
+}
+
+//等待管道可读，由Fiber稍后写入
+void test_wait_event()
+{
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    {
+        IOManager iom(2, true);
+        Future<int> future = coSpawn(read_one(fds[0]), &iom);
+        iom.scheduleLock([&fds]()
+        {
+            usleep(20 * 1000);
+            CHECK(write(fds[1], "x", 1) == 1);
+        });
+        CHECK(future.get() == 'x');
+    }
+    close(fds[0]);
+    close(fds[1]);
+    std::cout << "waitEvent: ok" << std::endl;
+}
+
+Task<long> async_consumer(Channel<int>& ch)
+{
+    long sum = 0;
+    int v;
+    while(co_await ch.recvAsync(v))
+    {
+        sum += v;
+    }
+    co_return sum;
+}
+
+Task<void> async_producer(Channel<int>& ch, int n)
+{
+    for(int i = 1; i <= n; ++i)
+    {
+        CHECK(co_await ch.sendAsync(i));
+    }
+    ch.close();
+}
+
+//无栈协程和Fiber在同一个调度器上通过Channel互相传递数据
+void test_channel_interop()
+{
+    const int n = 10000;
+    {
+        IOManager iom(2, true);
+        Channel<int> ch(8);
+        Future<long> sum = coSpawn(async_consumer(ch), &iom);
+        iom.scheduleLock([&ch]()
+        {
+            for(int i = 1; i <= n; ++i)
+            {
+                CHECK(ch.send(i));
+            }
+            ch.close();
+        });
+        CHECK(sum.get() == (long)n * (n + 1) / 2);
+    }
+    std::atomic<long> sum = {0};
+    {
+        Channel<int> ch(8);
+        IOManager iom(2, true);
+        coSpawn(async_producer(ch, n), &iom);
+        iom.scheduleLock([&ch, &sum]()
+        {
+            int v;
+            while(ch.recv(v))
+            {
+                sum += v;
+            }
+        });
+    }
+    CHECK(sum == (long)n * (n + 1) / 2);
+    std::cout << "channel interop: ok" << std::endl;
+}
+
+struct Tag
+{
+    static std::atomic<int> live;
+    int id = 0;
+    Tag() { ++live; }
+    ~Tag() { --live; }
+};
+std::atomic<int> Tag::live = {0};
+
+static FiberLocal<Tag> s_tag;
+
+Task<int> child_sees_tag()
+{
+    co_await sleepFor(1);
+    co_return s_tag->id;
+}
+
+//设置自己的FiberLocal、取消令牌和截止时间后挂起，恢复后(可能在另一个线程)检查还是自己的，
+//co_await的子协程看到同一份
+Task<void> context_owner(int id, std::atomic<int>& ok)
+{
+    std::shared_ptr<CancellationToken> token = std::make_shared<CancellationToken>();
+    CancellationScope cancel_scope(token);
+    DeadlineScope deadline_scope(10000 + id * 1000);
+    s_tag->id = id;
+    for(int i = 0; i < 5; ++i)
+    {
+        co_await sleepFor(2);
+        CHECK(s_tag->id == id);
+        CHECK(CancellationToken::getCurrent() == token);
+        uint64_t remaining = DeadlineScope::getRemaining();
+        CHECK(remaining <= (uint64_t)(10000 + id * 1000) && remaining + 500 > (uint64_t)(10000 + id * 1000));
+    }
+    CHECK(co_await child_sees_tag() == id);
+    ++ok;
+}
+
+//同一个调度协程上交替运行的协程和inline回调互相看不到对方的上下文，协程结束时FiberLocal被销毁
+void test_context()
+{
+    std::atomic<int> ok = {0};
+    std::atomic<int> leaked = {0};
+    {
+        IOManager iom(2, true);
+        std::vector<Future<void>> futures;
+        for(int id = 1; id <= 8; ++id)
+        {
+            futures.push_back(coSpawn(context_owner(id, ok), &iom));
+        }
+        for(int i = 0; i < 50; ++i)
+        {
+            iom.scheduleInline([&leaked]()
+            {
+                if(CancellationToken::getCurrent() || DeadlineScope::getRemaining() != ~0ull || s_tag.has())
+                {
+                    ++leaked;
+                }
+            });
+        }
+        for(auto& future : futures)
+        {
+            future.get();
+        }
+    }
+    CHECK(ok == 8);
+    CHECK(leaked == 0);
+    CHECK(Tag::live == 0);
+    std::cout << "per-coroutine context: ok" << std::endl;
+}
+
+static size_t heap_in_use()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+Task<void> parked_task(int ms)
+{
+    co_await sleepFor(ms);
+}
+
+//同时挂起count个无栈协程或count个Fiber，比较堆内存的增长
+void bench_memory(int count)
+{
+    std::atomic<size_t> task_bytes = {0};
+    std::atomic<size_t> fiber_bytes = {0};
+    {
+        IOManager iom(1, true);
+        iom.scheduleLock([count, &task_bytes, &fiber_bytes]()
+        {
+            IOManager* iom = IOManager::getThis();
+
+            size_t before = heap_in_use();
+            std::vector<Future<void>> futures;
+            futures.reserve(count);
+            for(int i = 0; i < count; ++i)
+            {
+                futures.push_back(coSpawn(parked_task(200), iom));
+            }
+            usleep(50 * 1000);  //让它们都执行到sleepFor并挂起
+            task_bytes = heap_in_use() - before;
+            for(auto& future : futures)
+            {
+                future.wait();
+            }
+            futures.clear();
+
+            before = heap_in_use();
+            WaitGroup wg;
+            wg.add(count);
+            for(int i = 0; i < count; ++i)
+            {
+                iom->scheduleLock([&wg]()
+                {
+                    usleep(200 * 1000);
+                    wg.done();
+                });
+            }
+            usleep(50 * 1000);
+            fiber_bytes = heap_in_use() - before;
+            wg.wait();
+        });
+    }
+    std::cout << "suspended Task<void>: " << task_bytes / count << " bytes each" << std::endl;
+    std::cout << "suspended Fiber:      " << fiber_bytes / count << " bytes each" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    test_results_and_exceptions();
+    test_sleep();
+    test_wait_event();
+    test_channel_interop();
+    test_context();
+    bench_memory(argc > 1 ? atoi(argv[1]) : 10000);
+    return 0;
+}
@@ -0,0 +1,213 @@
+// WaitGroup、TaskGroup和取消令牌的行为测试。
+// 编译(在hook/目录下): g++ -std=c++17 -O2 -I. tests/test_taskgroup.cpp $(ls *.cpp | grep -v '^test.cpp$') -o test_taskgroup -ldl -lpthread
+
+#include "taskgroup.h"
+#include "ioscheduler.h"
+#include "hook.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+            exit(1); \
+        } \
+    } while(0)
+
+static long elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+//在调度器中运行fn并等待它结束
+template <class Fn>
+static void run_in_iomanager(int threads, Fn fn)
+{
+    std::atomic<bool> done = {false};
+    {
+        IOManager iom(threads, true);
+        iom.scheduleLock([&done, fn]()
+        {
+            fn();
+            done = true;
+        });
+    }
+    CHECK(done);
+}
+
+void test_wait_group()
+{
+    run_in_iomanager(2, []()
+    {
+        WaitGroup wg;
+        std::atomic<int> finished = {0};
+        for(int i = 0; i < 100; ++i)
+        {
+            wg.add(1);
+            Scheduler::getThis()->scheduleLock([&wg, &finished, i]()
+            {
+                usleep((i % 5) * 1000);
+                ++finished;
+                wg.done();
+            });
+        }
+        wg.wait();
+        CHECK(finished == 100);
+
+        //计数为0时wait()立即返回
+        WaitGroup empty;
+        empty.wait();
+    });
+    std::cout << "WaitGroup: ok" << std::endl;
+}
+
+void test_task_group()
+{
+    run_in_iomanager(2, []()
+    {
+        std::atomic<int> finished = {0};
+        {
+            TaskGroup group;
+            for(int i = 0; i < 10; ++i)
+            {
+                group.spawn([&finished]()
+                {
+                    usleep(5 * 1000);
+                    ++finished;
+                });
+            }
+            group.wait();
+            CHECK(finished == 10);
+        }
+
+        //只能移动的任务
+        {
+            TaskGroup group;
+            std::unique_ptr<int> value(new int(7));
+            int seen = 0;
+            group.spawn([value = std::move(value), &seen]()
+            {
+                seen = *value;
+            });
+            group.wait();
+            CHECK(seen == 7);
+        }
+
+        //析构时等待还没结束的子任务
+        {
+            TaskGroup group;
+            group.spawn([&finished]()
+            {
+                usleep(20 * 1000);
+                ++finished;
+            });
+        }
+        CHECK(finished == 11);
+    });
+    std::cout << "TaskGroup: ok" << std::endl;
+}
+
+//一个子任务抛出异常，挂起在sleep和read上的兄弟任务以ECANCELED提前返回，wait()重新抛出异常
+void test_failure_cancels_siblings()
+{
+    run_in_iomanager(2, []()
+    {
+        int fds[2];
+        CHECK(pipe(fds) == 0);
+
+        std::atomic<int> sleep_errno = {0};
+        std::atomic<int> read_errno = {0};
+        auto start = std::chrono::steady_clock::now();
+        TaskGroup group;
+        group.spawn([&sleep_errno]()
+        {
+            if(usleep(5 * 1000 * 1000) == -1)
+            {
+                sleep_errno = errno;
+            }
+        });
+        group.spawn([&read_errno, &fds]()
+        {
+            char c;
+            if(read(fds[0], &c, 1) == -1)
+            {
+                read_errno = errno;
+            }
+        });
+        group.spawn([]()
+        {
+            usleep(20 * 1000);
+            throw std::runtime_error("child failed");
+        });
+
+        bool caught = false;
+        try
+        {
+            group.wait();
+        }
+        catch(const std::runtime_error& e)
+        {
+            caught = std::string(e.what()) == "child failed";
+        }
+        CHECK(caught);
+        CHECK(group.isCancelled());
+        CHECK(sleep_errno == ECANCELED);
+        CHECK(read_errno == ECANCELED);
+        CHECK(elapsed_ms(start) < 1000);
+        close(fds[0]);
+        close(fds[1]);
+    });
+    std::cout << "failure cancels siblings: ok" << std::endl;
+}
+
+//外层组取消时，内层组的子任务一并取消；取消之后spawn的任务不再启动
+void test_nested_cancel()
+{
+    run_in_iomanager(2, []()
+    {
+        std::atomic<int> inner_errno = {0};
+        std::atomic<bool> late_ran = {false};
+        auto start = std::chrono::steady_clock::now();
+        TaskGroup outer;
+        outer.spawn([&inner_errno]()
+        {
+            TaskGroup inner;
+            inner.spawn([&inner_errno]()
+            {
+                if(usleep(5 * 1000 * 1000) == -1)
+                {
+                    inner_errno = errno;
+                }
+            });
+            inner.wait();
+        });
+
+        usleep(20 * 1000);
+        outer.cancel();
+        outer.spawn([&late_ran]()
+        {
+            late_ran = true;
+        });
+        outer.wait();
+        CHECK(inner_errno == ECANCELED);
+        CHECK(!late_ran);
+        CHECK(elapsed_ms(start) < 1000);
+    });
+    std::cout << "nested cancel: ok" << std::endl;
+}
+
+int main()
+{
+    test_wait_group();
+    test_task_group();
+    test_failure_cancels_siblings();
+    test_nested_cancel();
+    return 0;
+}
@@ -1,5 +1,10 @@
 #include "thread.h"
 
+#include <sched.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
 
 static thread_local Thread* t_thread = nullptr;
 static thread_local std::string t_thread_name = "UNKNOW";
@@ -53,6 +58,102 @@ void Thread::join()
     }
 }
 
+int Thread::setAffinity(const std::vector<int>& cpus)
+{
+    if(!m_thread)
+    {
+        return ESRCH;
+    }
+    return setAffinity(m_thread, cpus);
+}
+
+int Thread::setCurrentAffinity(const std::vector<int>& cpus)
+{
+    return setAffinity(pthread_self(), cpus);
+}
+
+int Thread::setAffinity(pthread_t thread, const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : cpus)
+    {
+        if(cpu >= 0 && cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if(CPU_COUNT(&set) == 0)
+    {
+        return EINVAL;
+    }
+    return pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+//解析"0-3,8-11"格式的CPU(或NUMA节点)列表
+static std::vector<int> parseCpuList(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while(std::getline(ss, range, ','))
+    {
+        int first = 0;
+        int last = 0;
+        int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if(n == 1)
+        {
+            last = first;
+        }
+        else if(n != 2)
+        {
+            continue;
+        }
+        for(int cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<std::vector<int>> Thread::getNumaNodes()
+{
+    std::vector<std::vector<int>> nodes;
+    //节点编号可能不连续，先读取在线节点列表
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string node_list;
+    if(online && std::getline(online, node_list))
+    {
+        for(int node : parseCpuList(node_list))
+        {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if(!in || !std::getline(in, list))
+            {
+                continue;
+            }
+            std::vector<int> cpus = parseCpuList(list);
+            if(!cpus.empty())   //跳过只有内存没有CPU的节点
+            {
+                nodes.push_back(cpus);
+            }
+        }
+    }
+
+    if(nodes.empty())
+    {
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        std::vector<int> cpus;
+        for(long cpu = 0; cpu < count; ++cpu)
+        {
+            cpus.push_back((int)cpu);
+        }
+        nodes.push_back(cpus);
+    }
+    return nodes;
+}
+
 pid_t Thread::getThreadId()
 {
     return syscall(SYS_gettid);
@@ -4,6 +4,9 @@
 #include <condition_variable>
 #include <functional>
 #include <iostream>
+#include <vector>
+#include <string>
+#include <pthread.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
@@ -52,6 +55,9 @@ public:
 
     void join();
 
+    //把线程绑定到cpus中的CPU上，成功返回0，失败返回错误码
+    int setAffinity(const std::vector<int>& cpus);
+
 public:
     //获取系统分配的线程id
     static pid_t getThreadId();
@@ -65,6 +71,13 @@ public:
     //设置当前线程的名称
     static void setCurrentThreadName(const std::string& name);
 
+    //把当前线程绑定到cpus中的CPU上，成功返回0，失败返回错误码
+    static int setCurrentAffinity(const std::vector<int>& cpus);
+
+    //每个NUMA节点上的在线CPU，从/sys/devices/system/node读取，
+    //读取失败(没有NUMA或者不是Linux)时返回包含所有CPU的一个节点
+    static std::vector<std::vector<int>> getNumaNodes();
+
 private:
     //线程函数
     /*
@@ -82,6 +95,8 @@ private:
     */
     static void* run(void* arg);
 
+    static int setAffinity(pthread_t thread, const std::vector<int>& cpus);
+
 private:
     pid_t m_id = -1;
     pthread_t m_thread = 0;
@@ -11,6 +11,7 @@ bool Timer::cancel()
     else
     {
         m_cb = nullptr;
+        m_recurring_cb.reset();
     }
 
     auto it = m_manage->m_timers.find(shared_from_this());  //从定时管理器中找到需要删除的定时器
@@ -78,9 +79,16 @@ bool Timer::reset(uint64_t ms, bool from_now)
     return true;
 }
 
-Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager *manager):
-            m_recurring(recurring), m_ms(ms), m_cb(cb), m_manage(manager)
+Timer::Timer(uint64_t ms, TaskFn cb, bool recurring, TimerManager *manager, bool run_inline):
+            m_recurring(recurring), m_ms(ms), m_cb(std::move(cb)), m_manage(manager), m_run_inline(run_inline)
 {
+    if(m_recurring && m_cb)
+    {
+        m_recurring_cb = std::make_shared<TaskFn>(std::move(m_cb));
+        std::shared_ptr<TaskFn> shared = m_recurring_cb;
+        m_cb = [shared]() { (*shared)(); };
+    }
+
     auto now = std::chrono::system_clock::now();
     m_next = now + std::chrono::milliseconds(m_ms);
 }
@@ -102,25 +110,23 @@ TimerManager::~TimerManager()
 {
 }
 
-std::shared_ptr<Timer> TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring)
+std::shared_ptr<Timer> TimerManager::addTimer(uint64_t ms, TaskFn cb, bool recurring, bool run_inline)
 {
-   std::shared_ptr<Timer> timer(new Timer(ms, cb, recurring, this));
+   std::shared_ptr<Timer> timer(new Timer(ms, std::move(cb), recurring, this, run_inline));
    addTimer(timer);
    return timer;
 }
 
-static void onTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb)
+std::shared_ptr<Timer> TimerManager::addConditionTimer(uint64_t ms, TaskFn cb, std::weak_ptr<void> weak_cond, bool recurring, bool run_inline)
 {
-    std::shared_ptr<void> tmp = weak_cond.lock();
-    if(tmp)
+    return addTimer(ms, [weak_cond, cb = std::move(cb)]() mutable
     {
-        cb();
-    }
-}
-
-std::shared_ptr<Timer> TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring)
-{
-    return addTimer(ms, std::bind(&onTimer, weak_cond, cb), recurring);
+        std::shared_ptr<void> tmp = weak_cond.lock();
+        if(tmp)
+        {
+            cb();
+        }
+    }, recurring, run_inline);
 }
 
 uint64_t TimerManager::getNextTimer()
@@ -156,7 +162,7 @@ uint64_t TimerManager::getNextTimer()
     }
 }
 
-void TimerManager::listExpiredCb(std::vector<std::function<void()>> &cbs)
+void TimerManager::listExpiredCb(std::vector<TaskFn> &cbs, std::vector<TaskFn>* inline_cbs)
 {
     auto now = std::chrono::system_clock::now();
 
@@ -170,18 +176,30 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>> &cbs)
         std::shared_ptr<Timer> temp = *m_timers.begin();
         m_timers.erase(m_timers.begin());
 
-        cbs.push_back(temp->m_cb);
-
+        TaskFn cb;
         if(temp->m_recurring)
         {
+            //回调还要留给下一次超时，这里只取一个共享它的引用
+            std::shared_ptr<TaskFn> shared = temp->m_recurring_cb;
+            cb = [shared]() { (*shared)(); };
+
             //重新加入时间堆
             temp->m_next = now + std::chrono::milliseconds(temp->m_ms);
             m_timers.insert(temp);
         }
         else
         {
-            //清理cb
-            temp->m_cb = nullptr;
+            //直接把回调移出来，m_cb随之清空
+            cb = std::move(temp->m_cb);
+        }
+
+        if(temp->m_run_inline && inline_cbs)
+        {
+            inline_cbs->push_back(std::move(cb));
+        }
+        else
+        {
+            cbs.push_back(std::move(cb));
         }
     }
 }
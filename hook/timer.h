@@ -10,6 +10,8 @@
 #include <mutex>
 #include <assert.h>
 
+#include "taskfn.h"
+
 class TimerManager;
 
 
@@ -25,7 +27,7 @@ public:
     bool reset(uint64_t ms, bool from_now);
 
 private:
-    Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager);
+    Timer(uint64_t ms, TaskFn cb, bool recurring, TimerManager* manager, bool run_inline);
 
 private:
     //是否循环
@@ -34,10 +36,14 @@ private:
     uint64_t m_ms = 0;
     //绝对超时时间
     std::chrono::time_point<std::chrono::system_clock> m_next;
-    //超时时触发的回调函数
-    std::function<void()> m_cb;
+    //超时时触发的回调函数，为空表示定时器已经触发或被取消
+    TaskFn m_cb;
+    //循环定时器每次超时都要执行一次回调，回调由各次执行共享(可能在不同线程上同时执行)
+    std::shared_ptr<TaskFn> m_recurring_cb;
     //管理此Timer的管理器
     TimerManager* m_manage = nullptr;
+    //回调不会阻塞，超时时直接在取出它的线程上执行
+    bool m_run_inline = false;
 
 private:
     //实现最小堆的比较函数
@@ -56,19 +62,20 @@ public:
     TimerManager();
     virtual ~TimerManager();
 
-    //添加Timer
-    std::shared_ptr<Timer> addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
+    //添加Timer。run_inline表示cb很短且不会阻塞或挂起协程(例如只是唤醒一个协程)，
+    //超时时直接在空闲协程中执行，不需要为它创建协程
+    std::shared_ptr<Timer> addTimer(uint64_t ms, TaskFn cb, bool recurring = false, bool run_inline = false);
 
     //添加条件Timer
-    std::shared_ptr<Timer> addConditionTimer(uint64_t ms, std::function<void()> cb, 
+    std::shared_ptr<Timer> addConditionTimer(uint64_t ms, TaskFn cb, 
                                                 std::weak_ptr<void> weak_cond, 
-                                                bool recurring = false);
+                                                bool recurring = false, bool run_inline = false);
 
     //拿到堆中最近的超时时间
     uint64_t getNextTimer();
 
-    //取出所有超时定时器的回调函数
-    void listExpiredCb(std::vector<std::function<void()>>& cbs);
+    //取出所有超时定时器的回调函数，inline_cbs不为空时run_inline的回调单独放入inline_cbs
+    void listExpiredCb(std::vector<TaskFn>& cbs, std::vector<TaskFn>* inline_cbs = nullptr);
 
     //堆中是否有timer
     bool hasTimer();